@@ -19,6 +19,7 @@
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#include "countTiles.hpp"
 
 // virtualをなくすと速くなるときはそうする
 #ifdef DISABLE_VIRTUAL
@@ -29,6 +30,9 @@
 #define NO_INHERIT
 #endif // DISABLE_VIRTUAL
 
+// TILESET_SWITCH_DISPATCHを定義すると、対子、刻子または順子のメンバ関数を、
+// 仮想関数ではなく種類をswitchで判別して呼ぶ
+
 namespace CountTiles {
     // 無効な入力に対する結果
     const char ResultForInvalidInput[] = "(invalid input)\n";
@@ -107,6 +111,15 @@ namespace CountTiles {
         return n;
     };
 
+    // (待ち, 対子)を決め打ちして、刻子と順子に分解しようとした数
+    struct PruneCount {
+        TileSize tried {0};   // 分解を試そうとした数
+        TileSize pruned {0};  // 牌の塊の数が3の倍数でないので、分解する前に除いた数
+    };
+
+    // スレッドごとに数える
+    thread_local PruneCount pruneCount;
+
     // 刻子または順子のバックトラッキング状態
     enum class Status {
         NOT_SEARCHED,       // まだ探していない
@@ -378,6 +391,68 @@ namespace CountTiles {
 
     ThreeTiles::Table ThreeTiles::instanceSet_;
 
+    // 対子、刻子または順子への参照
+    class TileSetRef {
+    public:
+        TileSetRef(void) = default;
+        TileSetRef(TilePair* pPair) : pTileSet_(pPair), kind_(Kind::PAIR) {}
+        TileSetRef(ThreeTiles* pThreeTiles) : pTileSet_(pThreeTiles), kind_(Kind::THREE_TILES) {}
+
+#ifdef TILESET_SWITCH_DISPATCH
+        // 種類が分かっているので、仮想関数表を引かずに直接呼ぶ
+        TileSetKey GetKey(bool open, TileType extraTile) const {
+            switch(kind_) {
+            case Kind::PAIR:
+                return static_cast<const TilePair*>(pTileSet_)->TilePair::GetKey(open, extraTile);
+            case Kind::THREE_TILES:
+            default:
+                return static_cast<const ThreeTiles*>(pTileSet_)->ThreeTiles::GetKey(open, extraTile);
+            }
+        }
+
+        bool HasTile(TileType tile) const {
+            switch(kind_) {
+            case Kind::PAIR:
+                return static_cast<const TilePair*>(pTileSet_)->TilePair::HasTile(tile);
+            case Kind::THREE_TILES:
+            default:
+                return static_cast<const ThreeTiles*>(pTileSet_)->ThreeTiles::HasTile(tile);
+            }
+        }
+
+        const std::string& ToString(bool open, TileType extraTile) const {
+            switch(kind_) {
+            case Kind::PAIR:
+                return static_cast<const TilePair*>(pTileSet_)->TilePair::ToString(open, extraTile);
+            case Kind::THREE_TILES:
+            default:
+                return static_cast<const ThreeTiles*>(pTileSet_)->ThreeTiles::ToString(open, extraTile);
+            }
+        }
+#else // TILESET_SWITCH_DISPATCH
+        TileSetKey GetKey(bool open, TileType extraTile) const {
+            return pTileSet_->GetKey(open, extraTile);
+        }
+
+        bool HasTile(TileType tile) const {
+            return pTileSet_->HasTile(tile);
+        }
+
+        const std::string& ToString(bool open, TileType extraTile) const {
+            return pTileSet_->ToString(open, extraTile);
+        }
+#endif // TILESET_SWITCH_DISPATCH
+
+    private:
+        enum class Kind {
+            PAIR,         // 対子
+            THREE_TILES,  // 刻子または順子
+        };
+
+        const TileSet* pTileSet_ {nullptr};
+        Kind kind_ {Kind::PAIR};
+    };
+
     // 対子 + 3 * 4
     class TilesWithPair NO_INHERIT {
     public:
@@ -484,53 +559,57 @@ namespace CountTiles {
 
         // 結果を文字列として取得する
         VIRTUAL_FUNC const std::string ToString(void) {
-            struct KeyIndex {
-                TileSize   index;     // 何組目か
-                TileSet*   pTileSet;  // 対子、刻子または順子
-                TileSetKey key;       // key
-            };
+            // 対子と刻子または順子の組の数。探し終わってから呼ぶので、どのループもすべての組を辿る。
+            constexpr decltype(numberOfThreeTiles_) SizeOfSets = MaxNumberOfThreeTiles + 1;
+            // 下位ビットに何組目かを入れたkey
+            using KeyIndexArray = std::array<TileSetKey, SizeOfSets>;
+            static_assert(SizeOfSets <= (1 << SizeOfIndexBits), "Too small SizeOfIndexBits");
+            assert(numberOfThreeTiles_ == MaxNumberOfThreeTiles);
 
             std::string strAll;
 
-            for(decltype(numberOfThreeTiles_) i = 0; i <= numberOfThreeTiles_; ++i) {
+            for(decltype(numberOfThreeTiles_) i = 0; i < SizeOfSets; ++i) {
                 // 同種の牌が複数あっても、i番目の対子,刻子,順子以外からは抜かない
-                if (!GetArrayElementRef(tileSetArray_, i).pTiles_->HasTile(extraTile_)) {
+                if (!GetArrayElementRef(tileSetArray_, i).tiles_.HasTile(extraTile_)) {
                     continue;
                 }
 
-                std::array<KeyIndex, MaxNumberOfThreeTiles+1> keyIndexArray;
-                for(decltype(numberOfThreeTiles_) j = 0; j <= numberOfThreeTiles_; ++j) {
-                    GetArrayElementRef(keyIndexArray, j) = KeyIndex{
-                        j, GetArrayElementRef(tileSetArray_, j).pTiles_,
-                        GetArrayElementRef(tileSetArray_, j).pTiles_->GetKey(i == j, extraTile_)};
+                KeyIndexArray keyIndexArray {};
+                for(decltype(numberOfThreeTiles_) j = 0; j < SizeOfSets; ++j) {
+                    const auto tileKey = GetArrayElementRef(tileSetArray_, j).tiles_.GetKey(i == j, extraTile_);
+                    GetArrayElementRef(keyIndexArray, j) = (tileKey << SizeOfIndexBits) | j;
                 }
 
-                std::sort(keyIndexArray.begin(), keyIndexArray.end(),
-                          [&](const KeyIndex& l, const KeyIndex& r) { return (l.key > r.key); } );
+                sortKeys(keyIndexArray);
                 TileSetKey key = 0;
-                for(decltype(numberOfThreeTiles_) j = 0; j <= numberOfThreeTiles_; ++j) {
-                    key = key * RadixOfThreeTiles + GetArrayElementRef(keyIndexArray, j).key;
+                for(decltype(numberOfThreeTiles_) j = 0; j < SizeOfSets; ++j) {
+                    key = key * RadixOfThreeTiles + (GetArrayElementRef(keyIndexArray, j) >> SizeOfIndexBits);
                 }
 
+                // 既に現れた待ち形なら文字列を作らない
                 if (localStrTable_.find(key) != localStrTable_.end()) {
                     continue;
                 }
 
-                std::string str;
-                auto strIndex = numberOfThreeTiles_ + 1;
+                // 組ごとの文字列は作ってあるので、つなげるだけでよい
+                std::array<char, MaxLengthOfString> buffer;
+                TileSize length = 0;
+                auto strIndex = SizeOfSets;
                 while(strIndex > 0) {
                     --strIndex;
-                    auto& keyIndex = GetArrayElementRef(keyIndexArray, strIndex);
-                    auto open = (i == keyIndex.index);
-                    str += keyIndex.pTileSet->ToString(open, extraTile_);
+                    const auto index = GetArrayElementRef(keyIndexArray, strIndex) & IndexMask;
+                    const auto& str = GetArrayElementRef(tileSetArray_, index).tiles_.ToString(i == index, extraTile_);
+                    ::memcpy(buffer.data() + length, str.data(), str.size());
+                    length += str.size();
                 }
 
-                localStrTable_[key] = str;
+                const std::string str(buffer.data(), length);
+                localStrTable_.emplace(key, str);
                 if (allStrTable_.find(key) == allStrTable_.end()) {
-                    allStrTable_[key] = str;
+                    allStrTable_.emplace(key, str);
                 }
 
-                strAll += str;
+                strAll.append(buffer.data(), length);
                 strAll += "\n";
             }
 
@@ -539,9 +618,35 @@ namespace CountTiles {
 
     private:
         static constexpr TileSize MaxNumberOfThreeTiles = 4;
+        static constexpr TileSize SizeOfIndexBits = 3;  // keyの下位に入れる、何組目かのビット数
+        static constexpr TileSetKey IndexMask = (1 << SizeOfIndexBits) - 1;
+        // 待ち形の文字列の最大長 : 14牌 + かっこ
+        static constexpr TileSize MaxLengthOfString = SizeOfCompleteTiles + (MaxNumberOfThreeTiles + 1) * 2;
+
+        // 5要素を降順に並べる比較交換網
+        // 比較結果で分岐せずに、大きい方と小さい方を入れ替える
+        static void sortKeys(std::array<TileSetKey, MaxNumberOfThreeTiles + 1>& keys) {
+            const auto exchange = [&keys](TileSize left, TileSize right) {
+                const auto l = keys[left];
+                const auto r = keys[right];
+                keys[left] = std::max(l, r);
+                keys[right] = std::min(l, r);
+            };
+
+            exchange(0, 3);
+            exchange(1, 4);
+            exchange(0, 2);
+            exchange(1, 3);
+            exchange(0, 1);
+            exchange(2, 4);
+            exchange(1, 2);
+            exchange(3, 4);
+            exchange(2, 3);
+            return;
+        }
 
         struct TileSetElement {
-            TileSet*    pTiles_;        // 対子、刻子または順子
+            TileSetRef  tiles_;         // 対子、刻子または順子
             ThreeTiles* pThreeTiles_;   // 見つかった刻子または順子
             Status      status_;        // 刻子と順子のどちらを探すか
             TileType    minTile_;       // 残りの牌のうち、最小の番号
@@ -615,15 +720,20 @@ namespace CountTiles {
             }
 
             // 待ち牌を決め打ちして、14牌があがり型を成しているかどうか調べる
-            for(auto extraTile = TileMin; extraTile <= TileMax; ++extraTile) {
-                // 同種の5牌目はない
-                if (table_.GetRemainingSize(extraTile) >= SizeOfOneTile) {
-                    continue;
-                }
+            auto candidates = getCandidateTiles();
+            while(candidates) {
+                const TileType extraTile = TileMin + __builtin_ctz(candidates);
+                candidates &= candidates - 1;
 
                 table_.PushTiles(extraTile, 1);
                 for(auto pairTile = TileMin; pairTile <= TileMax; ++pairTile) {
                     if (table_.GetRemainingSize(pairTile) >= 2) {
+                        ++pruneCount.tried;
+                        if (!isSplittable(pairTile)) {
+                            ++pruneCount.pruned;
+                            continue;
+                        }
+
                         // 同種の牌が2,3,4枚あったら対子として扱う
                         TilesWithPair tiles(extraTile, pairTile, table_, localStrTable_, allStrTable_);
                         str += search(tiles);
@@ -637,6 +747,44 @@ namespace CountTiles {
         }
 
     private:
+        // 待ちになりうる牌の集合を、牌1..9をbit 0..8に置いて返す
+        // 手牌のどれかの牌から2つ以内にあって、4牌揃っていない牌だけが待ちになりうる
+        unsigned int getCandidateTiles(void) const {
+            unsigned int occupied = 0;
+            unsigned int full = 0;
+            for(auto tile = TileMin; tile <= TileMax; ++tile) {
+                const auto size = table_.GetRemainingSize(tile);
+                occupied |= ((size > 0) ? 1u : 0u) << (tile - TileMin);
+                full |= ((size >= SizeOfOneTile) ? 1u : 0u) << (tile - TileMin);
+            }
+
+            const unsigned int allTiles = (1u << KindOfTiles) - 1;
+            const auto candidates = occupied | (occupied << 1) | (occupied << 2) | (occupied >> 1) | (occupied >> 2);
+            return candidates & ~full & allTiles;
+        }
+
+        // 対子を除いた残りが、刻子と順子に分解できる見込みがあるかどうかを、分解する前に調べる
+        // 牌が隣り合って続く塊ごとに、牌の数が3の倍数でなければ分解できない
+        bool isSplittable(TileType pairTile) const {
+            TileSize blockSize = 0;
+            for(auto tile = TileMin; tile <= TileMax + 1; ++tile) {
+                TileSize size = 0;
+                if (tile <= TileMax) {
+                    size = table_.GetRemainingSize(tile) - ((tile == pairTile) ? 2 : 0);
+                }
+
+                if (size > 0) {
+                    blockSize += size;
+                } else if ((blockSize % 3) != 0) {
+                    return false;
+                } else {
+                    blockSize = 0;
+                }
+            }
+
+            return true;
+        }
+
         const std::string search(TilesWithPair& tiles) {
             if (tiles.IsComplete()) {
                 // 上がり形
@@ -660,6 +808,79 @@ namespace CountTiles {
         bool fail_;
     };
 
+    // 手牌を辞書順に一つずつ作る
+    // 再帰もヒープの確保もせずに、固定長の文字列と牌の数の配列を書き換える
+    class HandGenerator NO_INHERIT {
+    public:
+        // 最初の手牌(1111222233334)にする
+        HandGenerator(void) {
+            counts_.fill(0);
+            fill(TileMin, SizeOfHandTiles);
+            return;
+        }
+
+        VIRTUAL_FUNC ~HandGenerator(void) = default;
+        HandGenerator(const HandGenerator&) = delete;
+        HandGenerator& operator=(const HandGenerator&) = delete;
+
+        // 次の手牌にする。最後の手牌だったらfalseを返す。
+        VIRTUAL_FUNC bool Next(void) {
+            // 後ろの牌から、一つ減らして残りをより大きい牌で埋められる牌を探す
+            TileSize remaining = counts_[TileMax];
+            counts_[TileMax] = 0;
+            for(auto tile = TileMax - 1; tile >= TileMin; --tile) {
+                if ((counts_[tile] > 0) &&
+                    ((remaining + 1) <= (SizeOfOneTile * static_cast<TileSize>(TileMax - tile)))) {
+                    --counts_[tile];
+                    fill(tile + 1, remaining + 1);
+                    return true;
+                }
+                remaining += counts_[tile];
+                counts_[tile] = 0;
+            }
+
+            return false;
+        }
+
+        // 手牌を表現する文字列("1111222233334", 終端文字なし)
+        VIRTUAL_FUNC const char* GetHand(void) const {
+            return hand_.data();
+        }
+
+        VIRTUAL_FUNC TileSize GetSize(void) const {
+            return hand_.size();
+        }
+
+        // ある種の牌が何枚あるか返す
+        VIRTUAL_FUNC TileSize GetCount(TileType tile) const {
+            return counts_[tile];
+        }
+
+    private:
+        static constexpr TileSize SizeOfHandTiles = SizeOfCompleteTiles - 1;
+
+        // head以降の牌を、小さい番号の牌からたくさん集めてremaining牌にして、文字列を作り直す
+        void fill(TileType head, TileSize remaining) {
+            for(auto tile = head; tile <= TileMax; ++tile) {
+                const auto n = std::min(remaining, SizeOfOneTile);
+                counts_[tile] = static_cast<uint8_t>(n);
+                remaining -= n;
+            }
+
+            TileSize index = 0;
+            for(auto tile = TileMin; tile <= TileMax; ++tile) {
+                for(TileSize i = 0; i < counts_[tile]; ++i) {
+                    hand_[index] = ConvertToChar(tile);
+                    ++index;
+                }
+            }
+            return;
+        }
+
+        std::array<uint8_t, TileMax + 1> counts_;  // 牌の種類ごとの数
+        std::array<char, SizeOfHandTiles> hand_;   // 手牌を表現する文字列
+    };
+
     // すべての牌の組み合わせ
     class AllTileSet {
     public:
@@ -697,9 +918,17 @@ namespace CountTiles {
 
         // 牌の組み合わせを数え上げて、結果を出力ストリームに格納する
         virtual void Enumerate(std::ostream& output) {
+            // 手牌ごとに文字列と対応表を作り直さずに、書き換えて使いまわす
             TileTable table;
             std::string str;
-            enumerate(str, TileMin, SizeOfCompleteTiles - 1, table, output);
+            HandGenerator generator;
+            do {
+                for(auto tile = TileMin; tile <= TileMax; ++tile) {
+                    table[tile] = generator.GetCount(tile);
+                }
+                str.assign(generator.GetHand(), generator.GetSize());
+                search(str, table, output);
+            } while (generator.Next());
         }
 
     private:
@@ -721,37 +950,6 @@ namespace CountTiles {
             return failed;
         }
 
-        // 再帰的に牌を設定する
-        // inputStr  : 手牌を表現する文字列("11223")
-        // head      : ここで加える牌の番号
-        // remaining : あと加えなければならない牌の数
-        void enumerate(const std::string& inputStr, TileType head, TileSize remaining,
-                       TileTable& table, std::ostream& output) {
-            if (remaining == 0) {
-                search(inputStr, table, output);
-                return;
-            }
-
-            if (head > TileMax) {
-                return;
-            }
-
-            // 小さい番号の牌からたくさん集める(0個を含む)
-            TileSize i = std::min(remaining, SizeOfOneTile) + 1;
-            do {
-                --i;
-                table[head] = i;
-                std::string newStr = inputStr;
-                for(TileSize j = 0; j < i; ++j) {
-                    newStr += ConvertToChar(head);
-                }
-                enumerate(newStr, head + 1, remaining - i, table, output);
-                table[head] = 0;
-            } while (i > 0);
-
-            return;
-        }
-
         // ある牌の組み合わせについてを待ちを取得する
         void search(const std::string& inputStr, const TileTable& table, std::ostream& output) {
             TileFullSet s(table, strTable_);
@@ -767,12 +965,48 @@ namespace CountTiles {
 
         TileStrTable strTable_;
     };
+
+    void PrepareTileSets(void) {
+        for(auto tile = TileMin; tile <= TileMax; ++tile) {
+            TilePair::GetInstance(tile);
+            ThreeTiles::GetInstance(ThreeTiles::Data {{tile, tile, tile}});
+            if (tile <= TileMax - 2) {
+                ThreeTiles::GetInstance(ThreeTiles::Data {{tile, tile + 1, tile + 2}});
+            }
+        }
+        return;
+    }
+
+    std::string SearchWaits(const std::string& hand) {
+        // 文字列の表はスレッドごとに持つ
+        static thread_local TileStrTable strTable;
+        TileFullSet s(hand, strTable);
+        std::string str = s.SearchAll();
+
+        if (str.empty()) {
+            str += "(none)\n";
+        }
+
+        return str;
+    }
 }
 
-// 引数を何かつけると、すべての牌の組み合わせについてまとめて標準出力に書き出す
+#ifndef COUNT_TILES_NO_MAIN
+
+// -v以外の引数を何かつけると、すべての牌の組み合わせについてまとめて標準出力に書き出す
 // 引数がないときは、それぞれ牌の組み合わせについて標準出力に書き出す
+// -vをつけると、分解する前に除いた(待ち, 対子)の数を標準エラー出力に書き出す
 int main(int argc, char* argv[]) {
-    const bool printAtOnce = (argc > 1);
+    bool printAtOnce = false;
+    bool verbose = false;
+    for(int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "-v") {
+            verbose = true;
+        } else {
+            printAtOnce = true;
+        }
+    }
+
     CountTiles::AllTileSet allTileSet;
 
     // 例題が解けることを確認する
@@ -788,8 +1022,14 @@ int main(int argc, char* argv[]) {
         std::cout << oss.str();
     }
 
+    if (verbose) {
+        std::cerr << "pairs: " << CountTiles::pruneCount.tried << " tried, "
+                  << CountTiles::pruneCount.pruned << " pruned before splitting\n";
+    }
+
     return 0;
 }
+#endif // COUNT_TILES_NO_MAIN
 
 /*
 Local Variables:
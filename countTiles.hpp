@@ -0,0 +1,27 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * countTiles.cpp を他のプログラムから使うときの宣言
+ * countTiles.cpp をCOUNT_TILES_NO_MAINを定義してコンパイルすると、main関数を除いてリンクできる
+ */
+
+#include <string>
+
+namespace CountTiles {
+    // すべての対子、刻子、順子をあらかじめ生成する
+    // 以後は複数のスレッドから同時にSearchWaitsを呼んでよい
+    extern void PrepareTileSets(void);
+
+    // 13牌の待ちをすべて探して文字列として返す。待ちがなければ"(none)\n"を返す。
+    extern std::string SearchWaits(const std::string& hand);
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,114 @@
+#!/usr/bin/ruby
+# coding: utf-8
+#
+# 決まった負荷を何回か実行して、所要時間の中央値を基準値と比べる
+# 使い方: ruby countTilesBench.rb [--runs=5] [--threshold=0.25] [--baseline=file] [--output=file] [--update-baseline]
+# 中央値が基準値の(1 + threshold)倍を超えた負荷があれば1を返す。結果はJSONで書き出す。
+# 他のプロセスに待たされた時間で結果が揺れないように、子プロセスのCPU時間(user + sys)で比べる。
+# ただしマルチスレッドの負荷は、並列に動けなくてもCPU時間は変わらないので、経過時間で比べる。
+
+require 'json'
+require 'optparse'
+require 'time'
+
+# 負荷の名前、コマンド、標準入力にするファイル(なければnil)、比べる時間(cpuまたはwall)
+QUERY_FILENAME = "logBenchQuery.txt".freeze
+WORKLOAD_SET = [["bits_1_thread",  "./countTilesBits",         nil,            "cpu"],
+                ["bits_n_threads", "./countTilesBits -N",      nil,            "wall"],
+                ["bits_query",     "./countTilesBits --query", QUERY_FILENAME, "cpu"],
+                ["cpp_engine",     "./countTilesCpp",          nil,            "cpu"]
+               ].map { |set| set.map { |v| v.nil? ? v : v.freeze }.freeze }.freeze
+
+# 問い合わせる手牌の数と、手牌を選ぶ乱数の種(毎回同じ手牌を問い合わせる)
+SIZE_OF_QUERIES = 100000
+QUERY_RANDOM_SEED = 1
+
+# 問い合わせる手牌を作る。全手牌は --waits-only の出力から得る。
+def writeQueryFile(filename)
+  handSet = `./countTilesBits --waits-only`.lines.map { |line| line.split(":").first }
+  raise "Cannot list hands" unless $?.success? && !handSet.empty?
+
+  random = Random.new(QUERY_RANDOM_SEED)
+  File.open(filename, "w") do |file|
+    SIZE_OF_QUERIES.times { file.puts handSet[random.rand(handSet.size)] }
+  end
+end
+
+# コマンドを一回実行して、経過時間とCPU時間を秒で返す
+def measure(command, inputFilename)
+  option = { :out => File::NULL }
+  option[:in] = inputFilename if inputFilename
+  startTimes = Process.times
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  raise "Failed: #{command}" unless system(command, option)
+  wall = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+  endTimes = Process.times
+  cpu = (endTimes.cutime + endTimes.cstime) - (startTimes.cutime + startTimes.cstime)
+  [wall, cpu]
+end
+
+def median(valueSet)
+  sortedSet = valueSet.sort
+  size = sortedSet.size
+  size.odd? ? sortedSet[size / 2] : ((sortedSet[size / 2 - 1] + sortedSet[size / 2]) / 2.0)
+end
+
+sizeOfRuns = 5
+threshold = 0.25
+baselineFilename = "countTilesBenchBaseline.json"
+outputFilename = "logBench.json"
+updateBaseline = false
+
+OptionParser.new do |opt|
+  opt.on("--runs=N", Integer, "runs per workload (default: #{sizeOfRuns})") { |v| sizeOfRuns = v }
+  opt.on("--threshold=R", Float, "allowed slowdown ratio (default: #{threshold})") { |v| threshold = v }
+  opt.on("--baseline=FILE", "baseline file (default: #{baselineFilename})") { |v| baselineFilename = v }
+  opt.on("--output=FILE", "JSON result file (default: #{outputFilename})") { |v| outputFilename = v }
+  opt.on("--update-baseline", "write medians to the baseline file") { updateBaseline = true }
+end.parse!(ARGV)
+
+writeQueryFile(QUERY_FILENAME)
+baseline = File.exist?(baselineFilename) ? JSON.parse(File.read(baselineFilename)) : {}
+baselineSet = baseline.fetch("workloads", {})
+
+regressed = false
+resultSet = {}
+WORKLOAD_SET.each do |name, command, inputFilename, clock|
+  # 一回目はページキャッシュを温めるために捨てる
+  measure(command, inputFilename)
+  runSet = Array.new(sizeOfRuns) { measure(command, inputFilename) }
+  wallMedian = median(runSet.map(&:first))
+  cpuMedian = median(runSet.map(&:last))
+  value = (clock == "wall") ? wallMedian : cpuMedian
+
+  result = { "command" => command, "clock" => clock, "cpu_runs" => runSet.map { |v| v.last.round(4) },
+             "wall_runs" => runSet.map { |v| v.first.round(4) }, "cpu_median" => cpuMedian.round(4),
+             "wall_median" => wallMedian.round(4), "median" => value.round(4) }
+  # 基準値を別の時間で測っていたら比べない(clockのない基準値はCPU時間)
+  base = (baselineSet.dig(name, "clock") || "cpu") == clock ? baselineSet.dig(name, "median") : nil
+  if base
+    ratio = value / base
+    result["baseline"] = base
+    result["ratio"] = ratio.round(3)
+    result["regressed"] = (ratio > (1.0 + threshold))
+    regressed ||= result["regressed"]
+  end
+  resultSet[name] = result
+
+  status = base ? format("%.3f x baseline %.3f s%s", ratio, base, result["regressed"] ? " REGRESSED" : "") : "no baseline"
+  puts format("%-16s median %.3f s %-4s (%s)", name, value, clock, status)
+end
+
+report = { "time" => Time.now.iso8601, "commit" => `git rev-parse --short HEAD 2>#{File::NULL}`.chomp,
+           "runs" => sizeOfRuns, "threshold" => threshold, "workloads" => resultSet }
+File.write(outputFilename, JSON.pretty_generate(report) + "\n")
+
+if updateBaseline
+  workloadSet = resultSet.map { |name, result| [name, { "clock" => result["clock"], "median" => result["median"] }] }.to_h
+  File.write(baselineFilename, JSON.pretty_generate({ "workloads" => workloadSet }) + "\n")
+  puts "Updated #{baselineFilename}"
+  exit(0)
+end
+
+puts (regressed ? "Regressed (threshold #{threshold})" : "Passed")
+exit(regressed ? 1 : 0)
@@ -3,6 +3,13 @@
  * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
  */
 
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace TileSetSolver {
@@ -11,6 +18,7 @@ namespace TileSetSolver {
     using SizeType = size_t;    // コレクションなどのサイズ一般
     using TileKey  = uint64_t;  // 待ちを一意に定めるキー
     using StrArray = std::vector<std::string>;    // 文字列の配列
+    using HandNumber = uint64_t;  // 13牌を1牌4bitで、小さい牌から上位に並べた値(0x1111222233334など)
 
     constexpr SizeType SizeOfTileSet = 5;  // 対子 + 刻子または順子 * 4 で5組
     constexpr SizeType SizeOfCompleteTiles = 14;  // あがり形の牌の数
@@ -20,11 +28,58 @@ namespace TileSetSolver {
     constexpr SizeType TileMax = 9;        // 牌の数字の最大値
     constexpr SizeType SizeOfKeyBits = 10; // 待ちを一意に定めるキーの、組みあたりビット数
     constexpr TileKey  OpenKey = 1 << (SizeOfKeyBits - 1);  // 待ち形のキー
+    constexpr SizeType SizeOfAllHands = 93600;    // 手牌の組み合わせの数
+    constexpr TileMap  TileLowerBits = 0x10842108421ull;  // 各牌の最下位bit(5n bit目)の集合
+    constexpr SizeType MaxSizeOfWaits = 32; // 一手牌の待ち形の数の上限(実際は14以下)
+    // 対子を決め打ちしたときの分解の数の上限(刻子と順子の二分岐 * 4段)
+    constexpr SizeType MaxSizeOfSolutions = 1 << (SizeOfTileSet - 1);
 
     // 一スレッドで、待ち形を列挙して、解いた結果をresultに格納する
     // indexOffset番目(先頭は0)から、stepSize個間隔で、待ち形を列挙する
     extern void EnumerateAll(SizeType indexOffset, SizeType stepSize, StrArray& result);
 
+    // countTiles.cpp の実装と、sizeOfThreads個のスレッドですべての手牌を解いて、結果を比べてosに書き出す
+    // 結果が一致すればtrueを返す
+    extern bool VerifyAll(SizeType sizeOfThreads, std::ostream& os);
+
+    // 13牌の数字からなる文字列を手牌の番号にする。手牌として正しくなければfalseを返す。
+    extern bool ParseHand(const std::string& str, HandNumber& number);
+    // 手牌の番号が、ParseHandが返す形の正しい手牌かどうか
+    extern bool IsValidHand(HandNumber number);
+    // 手牌の番号を13牌の文字列にする
+    extern std::string HandToString(HandNumber number);
+    // 手牌の番号から、EnumerateAllが列挙する順番(先頭は0)を求める
+    extern SizeType GetHandRank(HandNumber number);
+    // EnumerateAllが列挙する順番(SizeOfAllHands未満)から、手牌の番号を求める
+    extern HandNumber GetHandNumber(SizeType rank);
+
+    // pathのUnixドメインソケットで待ちを問い合わせる要求を、sizeOfThreads個のスレッドで受け付ける
+    // 終了を要求されたらtrueを、ソケットを使えなければfalseを返す
+    extern bool RunServer(const std::string& path, SizeType sizeOfThreads, std::ostream& log);
+    // pathのサーバに、sizeOfConnections個の接続から合計sizeOfRequests個の手牌を問い合わせて、遅延時間をosに書き出す
+    extern bool RunClient(const std::string& path, SizeType sizeOfConnections, SizeType sizeOfRequests,
+                          bool shutdown, std::ostream& os);
+
+    // 論理CPUの配置
+    struct CpuPlacement {
+        int cpu;      // 論理CPUの番号
+        int package;  // 物理パッケージ(分からなければ-1)
+        int core;     // パッケージ内の物理コア(分からなければ-1)
+        int node;     // NUMAノード(分からなければ-1)
+    };
+
+    // "0,2,4-6" 形式の論理CPUの一覧をcpuSetに追加する。解釈できないか、逆順の範囲か、
+    // 番号がCPU_SETSIZE以上ならfalseを返す。
+    extern bool ParseCpuList(const std::string& str, std::vector<int>& cpuSet);
+    // 論理CPUの配置を返す
+    extern CpuPlacement GetCpuPlacement(int cpu);
+    // candidates(空なら稼働中のすべての論理CPU)から、物理コアごとに一つずつ論理CPUを選ぶ
+    extern std::vector<int> GetPhysicalCoreCpus(const std::vector<int>& candidates);
+    // 呼び出したスレッドを論理CPUに固定する。固定できなければfalseを返す。
+    extern bool PinCurrentThread(int cpu);
+    // 呼び出したスレッドが以後確保するメモリを、実行中のNUMAノードに置く。できなければfalseを返す。
+    extern bool UseLocalMemory(void);
+
     // 結果の文字列
     // 関数の返り値になるように、構造体でboxingする
     struct ResultString {
@@ -36,8 +91,495 @@ namespace TileSetSolver {
     // 1..3牌 + 区切り記号を8byte単位でコピーするので、余分に5文字書き込むことがある
     static_assert((sizeof(char) * (ResultStringLength + 5)) <= sizeof(ResultString), "Too small");
 
-    using KeyArray = std::vector<TileKey>;                // キーの配列
-    using ResultStringArray = std::vector<ResultString>;  // 文字列の配列
+    // 固定長の配列
+    // 要素をスタック上に置くのでヒープを確保しない。上限を超えて追加すると例外を投げる。
+    template <typename T, SizeType N>
+    class FixedArray {
+    public:
+        using value_type = T;
+        using iterator = typename std::array<T, N>::iterator;
+        using const_iterator = typename std::array<T, N>::const_iterator;
+
+        inline FixedArray(void) : size_(0) {
+            return;
+        }
+
+        inline void push_back(const T& value) {
+            if (size_ >= N) {
+                throw std::length_error("FixedArray overflow");
+            }
+            array_[size_] = value;
+            ++size_;
+            return;
+        }
+
+        inline void clear(void) {
+            size_ = 0;
+            return;
+        }
+
+        inline SizeType size(void) const {
+            return size_;
+        }
+
+        inline bool empty(void) const {
+            return (size_ == 0);
+        }
+
+        inline iterator begin(void) {
+            return array_.begin();
+        }
+
+        inline iterator end(void) {
+            return array_.begin() + size_;
+        }
+
+        inline const_iterator begin(void) const {
+            return array_.begin();
+        }
+
+        inline const_iterator end(void) const {
+            return array_.begin() + size_;
+        }
+
+    private:
+        std::array<T, N> array_;
+        SizeType size_;
+    };
+
+    // 遅延時間の分布
+    // HDR Histogramと同様に、値を2の冪ごとの区間に分けて、各区間をさらに等分して数える
+    class LatencyHistogram {
+    public:
+        inline LatencyHistogram(void) : total_(0), max_(0) {
+            counts_.fill(0);
+            return;
+        }
+
+        inline void Record(uint64_t value) {
+            ++counts_[getIndex(value)];
+            ++total_;
+            max_ = (value > max_) ? value : max_;
+            return;
+        }
+
+        inline void Merge(const LatencyHistogram& other) {
+            for(SizeType i = 0; i < SizeOfBuckets; ++i) {
+                counts_[i] += other.counts_[i];
+            }
+            total_ += other.total_;
+            max_ = (other.max_ > max_) ? other.max_ : max_;
+            return;
+        }
+
+        inline uint64_t GetCount(void) const {
+            return total_;
+        }
+
+        inline uint64_t GetMax(void) const {
+            return max_;
+        }
+
+        // percentile (0..100) 番目の値を、区間の上限で返す
+        inline uint64_t GetPercentile(double percentile) const {
+            const uint64_t threshold = static_cast<uint64_t>(static_cast<double>(total_) * percentile / 100.0 + 0.5);
+            uint64_t count = 0;
+            for(SizeType i = 0; i < SizeOfBuckets; ++i) {
+                count += counts_[i];
+                if ((count > 0) && (count >= threshold)) {
+                    const uint64_t upper = getLowerValue(i + 1) - 1;
+                    return (upper < max_) ? upper : max_;
+                }
+            }
+            return max_;
+        }
+
+    private:
+        static constexpr SizeType SubBucketBits = 5;  // 誤差は1/16以下
+        static constexpr SizeType SizeOfHalfSubBuckets = 1 << (SubBucketBits - 1);
+        static constexpr SizeType SizeOfBuckets = (64 - SubBucketBits + 2) * SizeOfHalfSubBuckets;
+
+        inline static SizeType getIndex(uint64_t value) {
+            if (value < (SizeOfHalfSubBuckets * 2)) {
+                return static_cast<SizeType>(value);
+            }
+            const SizeType shift = (63 - __builtin_clzll(value)) - (SubBucketBits - 1);
+            return shift * SizeOfHalfSubBuckets + static_cast<SizeType>(value >> shift);
+        }
+
+        inline static uint64_t getLowerValue(SizeType index) {
+            if (index < (SizeOfHalfSubBuckets * 2)) {
+                return index;
+            }
+            const SizeType shift = index / SizeOfHalfSubBuckets - 1;
+            return static_cast<uint64_t>(index - shift * SizeOfHalfSubBuckets) << shift;
+        }
+
+        std::array<uint64_t, SizeOfBuckets> counts_;
+        uint64_t total_;
+        uint64_t max_;
+    };
+
+    using WaitKeyArray = FixedArray<TileKey, MaxSizeOfWaits>;  // 待ち形のキーの配列
+
+    // 一手牌を解いた結果
+    struct WaitResult {
+        TileMap waitMask;   // 待ち牌の集合(1..9をbit 0..8に置く)
+        WaitKeyArray keys;  // 待ち形のキー(出力順)
+    };
+
+    // 書き出す手牌の条件。既定値ではすべての手牌を書き出す。
+    struct HandFilter {
+        TileMap  waitMask {0};       // 待ち牌にすべて含む牌の集合(1..9をbit 0..8に置く)
+        TileMap  requiredTiles {0};  // 手牌に含む牌(牌の数をSizeOfBitsPerTileビットごとに並べたビット列)
+        SizeType minSizeOfForms {0};               // 待ち形の数の下限
+        SizeType maxSizeOfForms {MaxSizeOfWaits};  // 待ち形の数の上限
+        bool     tenpaiOnly {false};  // 待ちのある手牌だけを書き出す
+
+        // tileMapの手牌が、解く前に調べられる条件を満たすかどうか
+        inline bool AcceptsTiles(TileMap tileMap) const {
+            return ((tileMap & requiredTiles) == requiredTiles);
+        }
+
+        // 待ち牌の集合が条件を満たすかどうか
+        inline bool AcceptsWaitMask(TileMap resultWaitMask) const {
+            return ((resultWaitMask & waitMask) == waitMask) && (!tenpaiOnly || (resultWaitMask != 0));
+        }
+
+        // 待ち形の数が条件を満たすかどうか
+        inline bool AcceptsForms(SizeType sizeOfForms) const {
+            return (sizeOfForms >= minSizeOfForms) && (sizeOfForms <= maxSizeOfForms);
+        }
+
+        // 解いた結果が条件を満たすかどうか
+        inline bool AcceptsWaits(const WaitResult& result) const {
+            return AcceptsWaitMask(result.waitMask) && AcceptsForms(result.keys.size());
+        }
+    };
+
+    // 一スレッドで、filterを満たす手牌だけを結果に格納する他は、EnumerateAllと同じ
+    extern void EnumerateAll(SizeType indexOffset, SizeType stepSize, const HandFilter& filter, StrArray& result);
+
+    // 手牌の順番(GetHandRank)の範囲 [first, last)
+    struct HandRange {
+        SizeType first {0};
+        SizeType last {SizeOfAllHands};
+
+        inline SizeType size(void) const {
+            return (last > first) ? (last - first) : 0;
+        }
+    };
+
+    // rangeの手牌だけを列挙する他は、filterを指定したEnumerateAllと同じ
+    // indexOffsetとstepSizeは、range.first番目の手牌を0番目として数える
+    extern void EnumerateRange(const HandRange& range, SizeType indexOffset, SizeType stepSize,
+                               const HandFilter& filter, StrArray& result);
+
+    // 手牌ごとの結果の文字列を、一つの連続した領域に続けて置いて、先頭からの位置の配列で引く
+    // 領域はできるだけヒュージページに置く。MAP_HUGETLBで確保できなければ、2MB境界に揃えた領域を
+    // madviseでTransparent Huge Pagesにし、それもできなければ通常のページを使う。
+    // 領域は最初に書き込んだスレッドのNUMAノードに置かれる。
+    class ResultBuffer {
+    public:
+        // 領域を確保した方法
+        enum Backing {
+            BackingHugeTlb,       // MAP_HUGETLB
+            BackingTransparent,   // Transparent Huge Pages
+            BackingNormal,        // 通常のページ
+            BackingHeap,          // mmapがない環境
+        };
+
+        // 文字列の合計がcapacity byte、数がsizeOfEntries個程度と見込んで確保する。足りなければ広げる。
+        ResultBuffer(SizeType capacity, SizeType sizeOfEntries);
+        ~ResultBuffer(void);
+        ResultBuffer(const ResultBuffer&) = delete;
+        ResultBuffer& operator=(const ResultBuffer&) = delete;
+
+        inline void push_back(const std::string& str) {
+            const SizeType used = offsets_.back();
+            if ((used + str.size()) > capacity_) {
+                grow(used + str.size());
+            }
+            ::memcpy(base_ + used, str.data(), str.size());
+            offsets_.push_back(static_cast<uint32_t>(used + str.size()));
+            return;
+        }
+
+        // 格納した文字列の数
+        inline SizeType size(void) const {
+            return offsets_.size() - 1;
+        }
+
+        // index番目の文字列の先頭と長さ
+        inline const char* GetData(SizeType index) const {
+            return base_ + offsets_[index];
+        }
+
+        inline SizeType GetLength(SizeType index) const {
+            return offsets_[index + 1] - offsets_[index];
+        }
+
+        // 格納した文字列をつないだ長さ
+        inline SizeType GetSizeOfBytes(void) const {
+            return offsets_.back();
+        }
+
+        Backing GetBacking(void) const;
+        static const char* GetBackingName(Backing backing);
+
+    private:
+        void allocate(SizeType capacity);
+        void release(void);
+        void grow(SizeType required);
+
+        char* base_;
+        SizeType capacity_;  // 文字列を置ける長さ
+        SizeType mapped_;    // 確保した長さ
+        Backing backing_;
+        std::vector<uint32_t> offsets_;  // i番目の文字列は[offsets_[i], offsets_[i+1])
+    };
+
+    // 結果をresultの領域に続けて置く他は、StrArrayに格納するEnumerateRangeと同じ
+    extern void EnumerateRange(const HandRange& range, SizeType indexOffset, SizeType stepSize,
+                               const HandFilter& filter, ResultBuffer& result);
+
+    // 一度に渡す手牌の数の上限
+    constexpr SizeType MaxPipelineBatchSize = 1024;
+
+    // 手牌を作る段、解く段、書き出す段に分けて解くときの設定
+    struct PipelineConfig {
+        SizeType sizeOfSolvers {1};  // 解く段のスレッド数
+        SizeType queueDepth {16};    // 段の間のリングバッファの長さ(2のべき乗に切り上げる)
+        SizeType batchSize {256};    // 一度に渡す手牌の数(MaxPipelineBatchSize以下)
+    };
+
+    // 全手牌を、手牌を作る段、解く段、書き出す段に分けて並行して解き、filterを満たす手牌を
+    // EnumerateAllと同じ順と形式でosに書き出す。reportがnullptrでなければ、段ごとの稼働率を書き出す。
+    // 書き出した手牌の数を返す。
+    extern SizeType SolvePipelined(const PipelineConfig& config, const HandFilter& filter,
+                                   std::ostream& os, std::ostream* report);
+
+    // 手牌を解いてresultに格納する
+    extern void SolveHand(HandNumber number, WaitResult& result);
+    // 手牌の待ち牌の集合(1..9をbit 0..8に置く)だけを求める。分解は待ち牌ごとに一つ見つけたら止める。
+    extern TileMap FindWaitMask(HandNumber number);
+    // 待ち形のキーを、EnumerateAllと同じ形式の文字列にしてstrに追記する。キーがなければ(none)と書く。
+    extern void PrintWaitKeys(const TileKey* keys, SizeType size, std::string& str);
+    // sizeOfThreads個のスレッドですべての手牌を解いて、待ちの数、待ち牌、分解の形を集計してosに書き出す
+    extern void CollectStats(SizeType sizeOfThreads, std::ostream& os);
+
+    // (待ち, 対子)を決め打ちして、刻子と順子に分解しようとした数
+    struct PruneCount {
+        uint64_t tried;   // 分解を試そうとした数
+        uint64_t pruned;  // 牌の塊の数が3の倍数でないので、分解する前に除いた数
+    };
+
+    // これまでに解いたすべての手牌についての、PruneCountの合計を返す
+    extern PruneCount GetPruneCount(void);
+
+    // 試した(待ち, 対子)の組の数を、0-7, 8-15, ..., 64- とBranchClassWidthごとに分けた数
+    // (全手牌で8から60程度に分布する)
+    constexpr SizeType BranchClassWidth = 8;
+    constexpr SizeType SizeOfBranchClasses = 9;
+
+    // 一手牌を解く時間(ナノ秒)の分布
+    struct SolveLatency {
+        LatencyHistogram all;
+        std::array<LatencyHistogram, TileMax + 1> byWaits;                // 待ち牌の数ごと
+        std::array<LatencyHistogram, SizeOfBranchClasses> byBranches;  // 試した(待ち, 対子)の組の数ごと
+
+        // 試した(待ち, 対子)の組の数を、byBranchesの添え字にする
+        inline static SizeType GetBranchClass(uint64_t branches) {
+            const SizeType branchClass = static_cast<SizeType>(branches / BranchClassWidth);
+            return (branchClass < SizeOfBranchClasses) ? branchClass : (SizeOfBranchClasses - 1);
+        }
+
+        inline void Record(uint64_t nsec, SizeType sizeOfWaits, uint64_t branches) {
+            all.Record(nsec);
+            byWaits[sizeOfWaits].Record(nsec);
+            byBranches[GetBranchClass(branches)].Record(nsec);
+            return;
+        }
+
+        inline void Merge(const SolveLatency& other) {
+            all.Merge(other.all);
+            for(SizeType i = 0; i < byWaits.size(); ++i) {
+                byWaits[i].Merge(other.byWaits[i]);
+            }
+            for(SizeType i = 0; i < byBranches.size(); ++i) {
+                byBranches[i].Merge(other.byBranches[i]);
+            }
+            return;
+        }
+    };
+
+    // 有効にすると、手牌ごとに解く時間を測る。EnumerateAllとEnumerateRangeはスレッドごとに測って
+    // 列挙を終えたときに、SolveHandは一手牌ごとに、全スレッドの合計に足す
+    extern void EnableSolveLatency(bool enable);
+    // スレッドごとに測った分布を、全スレッドの合計に足す
+    extern void MergeSolveLatency(const SolveLatency& latency);
+    // 一手牌を解いた時間を、全スレッドの合計に足す
+    extern void RecordSolveLatency(uint64_t nsec, SizeType sizeOfWaits, uint64_t branches);
+    // これまでに測ったすべてのスレッドの合計をlatencyに足す
+    extern void GetSolveLatency(SolveLatency& latency);
+
+    // 性能カウンタで数える区間
+    enum PerfPhase {
+        PerfEnumerate,  // 手牌を列挙して文字列にする
+        PerfDecompose,  // 待ちと分解を求める
+        PerfFilter,     // 書き出す手牌の条件を調べる
+        PerfPrint,      // 待ちを文字列にして結果に加える
+        PerfOutput,     // 結果を書き出す
+        SizeOfPerfPhases
+    };
+
+    // 性能カウンタの種類
+    enum PerfEvent {
+        PerfTaskClock,     // スレッドが動いていた時間(ナノ秒)
+        PerfCycles,        // サイクル数
+        PerfInstructions,  // 命令数
+        PerfBranchMisses,  // 分岐予測ミス
+        PerfL1dMisses,     // L1データキャッシュの読み込みミス
+        SizeOfPerfEvents
+    };
+
+    using PerfValues = std::array<uint64_t, SizeOfPerfEvents>;
+
+    // 一つのスレッドが区間ごとに数えた値
+    struct PerfThreadCount {
+        std::string name;                              // スレッドの名前
+        std::array<bool, SizeOfPerfEvents> available;  // 数えられた種類
+        std::array<PerfValues, SizeOfPerfPhases> values;
+        uint64_t switches;                             // 区間を切り替えた回数
+        bool multiplexed;                              // 他のカウンタと共有したので一部しか数えていない
+    };
+
+    // 呼び出したスレッドの性能カウンタを、区間ごとに分けて数える
+    // 破棄するときに、数えた値を全スレッドの結果に加える
+    class PerfCollector {
+    public:
+        PerfCollector(const std::string& name, PerfPhase phase);
+        ~PerfCollector(void);
+        PerfCollector(const PerfCollector&) = delete;
+        PerfCollector& operator=(const PerfCollector&) = delete;
+
+        // 数えられるカウンタがあればtrueを返す
+        bool IsOpen(void) const;
+        // 今の区間を終えて、phaseを数え始める
+        void Switch(PerfPhase phase);
+
+    private:
+        void accumulate(void);
+        bool read(PerfValues& values, uint64_t& enabled, uint64_t& running) const;
+
+        std::array<int, SizeOfPerfEvents> fdSet_;  // 開けなかった種類は-1
+        int leader_;                               // グループの先頭のfd
+        PerfPhase phase_;
+        PerfValues last_;                          // 直前に読んだ値
+        PerfValues overhead_;                      // 一回読むのに掛かる分
+        PerfThreadCount count_;
+    };
+
+    // perf_event_openで性能カウンタを数えられるか調べて、数えられれば有効にする
+    // 数えられなければ理由を、一部しか数えられなければ数えられない種類をmessageに格納する
+    extern bool EnablePerfCounters(std::string& message);
+    // 有効なら、呼び出したスレッドでphaseから数え始めるPerfCollectorを返す。無効ならnullptrを返す。
+    // 名前は有効なときだけ作るので、無効ならヒープを確保しない。
+    extern std::unique_ptr<PerfCollector> StartPerfCounters(const char* name, PerfPhase phase);
+    // 名前の後にindexをつける他は、上と同じ
+    extern std::unique_ptr<PerfCollector> StartPerfCounters(const char* name, SizeType index, PerfPhase phase);
+    // これまでに数え終えたスレッドの結果を返す
+    extern std::vector<PerfThreadCount> GetPerfCounters(void);
+    // 区間とカウンタの種類の名前を返す
+    extern const char* GetPerfPhaseName(PerfPhase phase);
+    extern const char* GetPerfEventName(PerfEvent event);
+    // 実行ファイル(countTilesBitsAlloc.cpp)がヒープを確保した回数を数え始める。ライブラリには含まない。
+    extern void EnableAllocationCount(void);
+    // 数え始めてから、すべてのスレッドがヒープを確保した回数を返す
+    extern SizeType GetAllocationCount(void);
+    // 手牌の番号を、牌の数をSizeOfBitsPerTileビットごとに並べたビット列にする
+    extern TileMap HandToTileMap(HandNumber number);
+
+    // 全手牌の待ちを格納した表(バイナリ形式)を読む
+    // 表は手牌の順番(GetHandRank)で引き、ヒープを確保せずに、与えられたメモリを直接参照する
+    class WaitTableView {
+    public:
+        WaitTableView(void);
+        // size byteのdataを表として使う。verifyChecksumならチェックサムも確かめる。正しい表でなければfalseを返す。
+        bool Attach(const void* data, SizeType size, bool verifyChecksum);
+        bool IsValid(void) const;
+        TileMap GetWaitMask(SizeType rank) const;
+        const TileKey* GetKeys(SizeType rank) const;
+        SizeType GetSizeOfKeys(SizeType rank) const;
+        // rank番目の手牌と待ちを、EnumerateAllと同じ形式でstrに追記する
+        void Print(SizeType rank, std::string& str) const;
+
+    private:
+        const uint32_t* offsets_;
+        const uint16_t* masks_;
+        const TileKey*  keys_;
+    };
+
+    // sizeOfThreads個のスレッドですべての手牌を解いて、表をバイナリ形式で作る
+    extern std::vector<char> BuildWaitTable(SizeType sizeOfThreads);
+    // 実行ファイルに埋め込んだ表をviewに設定する。埋め込まれていなければfalseを返す。
+    extern bool GetEmbeddedWaitTable(WaitTableView& view);
+
+    // 待ち形の種類
+    enum WaitShape {
+        WaitSingle,  // 単騎 [1]
+        WaitPair,    // 双碰 [11]
+        WaitSides,   // 両面 [23]
+        WaitEdge,    // 辺張 [12], [89]
+        WaitClosed,  // 嵌張 [13]
+        SizeOfWaitShapes
+    };
+
+    // 待ち形の種類の名前(single, pair, sides, edge, closed)を返す
+    extern const char* GetWaitShapeName(WaitShape shape);
+    // 待ち形の一組のキー(SizeOfKeyBits bit)から、待ち形の種類を求める
+    extern WaitShape GetWaitShape(TileKey openKey);
+    // 待ち形の一組のキー(SizeOfKeyBits bit)を、[23]の形式の文字列にする
+    extern std::string OpenKeyToString(TileKey openKey);
+
+    // 手牌の順番(GetHandRank)の集合を、SizeOfAllHands bitのビット列で表す
+    class HandSet {
+    public:
+        HandSet(void);
+        void Add(SizeType rank);
+        bool Contains(SizeType rank) const;
+        // 含む手牌の数を返す
+        SizeType Count(void) const;
+        HandSet& operator&=(const HandSet& other);
+        HandSet& operator|=(const HandSet& other);
+        // otherに含む手牌を除く
+        HandSet& AndNot(const HandSet& other);
+
+    private:
+        static constexpr SizeType SizeOfWords = (SizeOfAllHands + 63) / 64;
+        std::array<uint64_t, SizeOfWords> words_;
+    };
+
+    // 全手牌の待ちの表から作る、待ち牌と待ち形ごとの手牌の集合
+    class HandIndex {
+    public:
+        explicit HandIndex(const WaitTableView& view);
+        // 項を & (積), | (和), - (差) でつないだ式を左から順に評価して、手牌の集合をresultに格納する
+        // 項は、1..9(その牌を待つ), single, pair, sides, edge, closed(その種類の待ち形がある),
+        // tenpai(待ちがある), [23](その待ち形がある)。解釈できなければfalseを返す。
+        bool Query(const std::string& expr, HandSet& result) const;
+
+    private:
+        // 項の手牌の集合を返す。解釈できなければnullptrを返す。
+        const HandSet* findTerm(const std::string& term) const;
+
+        std::array<HandSet, TileMax + 1> waitTileSet_;      // 待ち牌ごと
+        std::array<HandSet, SizeOfWaitShapes> waitShapeSet_;  // 待ち形の種類ごと
+        std::vector<std::string> openKeyNameSet_;  // 待ち形の文字列
+        std::vector<HandSet> openKeySet_;          // 待ち形ごと(openKeyNameSet_と同じ順)
+        HandSet tenpaiSet_;                        // 待ちがある
+        HandSet emptySet_;                         // どの手牌にもない待ち形
+    };
 }
 
 /*
@@ -0,0 +1,125 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * ヒープを確保した回数を数えるために、グローバルなoperator newとoperator deleteを置き換える
+ * 確保と解放の組がすべてmallocとfreeで揃うように、通常、配列、サイズ付き、nothrowの全形式を置き換える。
+ * 呼び出し側に本体が展開されないように、他のファイルと分けておく。
+ * 数えるのは-vで有効にしたときだけで、無効なら共有する変数には書かない。
+ * 有効なら、スレッドごとに別のキャッシュラインの欄に数えて、読むときに足し合わせる。
+ */
+
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include "countTilesBits.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    // 数える欄の数。これより多いスレッドは欄を共有する。
+    constexpr SizeType SizeOfAllocationSlots = 64;
+
+    // スレッドごとのヒープを確保した回数。他のスレッドと同じキャッシュラインに置かない。
+    struct alignas(64) AllocationSlot {
+        std::atomic<SizeType> count;
+    };
+
+    std::atomic<bool> allocationCountEnabled {false};
+    std::atomic<SizeType> sizeOfAllocationThreads {0};
+    AllocationSlot allocationSlotSet[SizeOfAllocationSlots];
+
+    // 初めて数えるときに、呼び出したスレッドの欄を決める
+    // 動的な初期化や破棄をするとoperator newを呼ぶかもしれないので、組み込み型だけを置く
+    thread_local AllocationSlot* currentAllocationSlot = nullptr;
+
+    void countAllocation(void) noexcept {
+        if (!allocationCountEnabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        if (!currentAllocationSlot) {
+            const auto index = sizeOfAllocationThreads.fetch_add(1, std::memory_order_relaxed);
+            currentAllocationSlot = &allocationSlotSet[index % SizeOfAllocationSlots];
+        }
+        currentAllocationSlot->count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    void* allocate(std::size_t size) noexcept {
+        countAllocation();
+        return std::malloc((size > 0) ? size : 1);
+    }
+
+    void* allocateOrThrow(std::size_t size) {
+        void* p = allocate(size);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+void* operator new(std::size_t size) {
+    return allocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+namespace TileSetSolver {
+    void EnableAllocationCount(void) {
+        allocationCountEnabled.store(true);
+        return;
+    }
+
+    SizeType GetAllocationCount(void) {
+        SizeType count = 0;
+        for(const auto& slot : allocationSlotSet) {
+            count += slot.count.load();
+        }
+        return count;
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,241 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * ライブラリのC言語インタフェース(countTilesBitsApi.h)の実装
+ * 複数の手牌をまとめて解く要求は、最初に呼ばれたときに作るスレッドプールで解く。
+ * 要求したスレッドも一緒に解き、手牌をChunkSize個ずつ取り合う。
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsApi.h"
+#include "countTilesBitsThread.hpp"
+
+using namespace TileSetSolver;
+
+static_assert(COUNT_TILES_MAX_WAITS == MaxSizeOfWaits, "Size of waits mismatch");
+static_assert(sizeof(CountTilesWaits) == (16 + sizeof(TileKey) * COUNT_TILES_MAX_WAITS), "ABI mismatch");
+
+namespace {
+    // 一度に取る手牌の数
+    constexpr SizeType ChunkSize = 64;
+
+    int solveOne(CountTilesHand hand, CountTilesWaits& waits) {
+        waits.waitMask = 0;
+        waits.sizeOfKeys = 0;
+        if (!IsValidHand(hand)) {
+            waits.status = COUNT_TILES_INVALID_HAND;
+            return COUNT_TILES_INVALID_HAND;
+        }
+
+        WaitResult result;
+        SolveHand(hand, result);
+        waits.status = COUNT_TILES_OK;
+        waits.waitMask = result.waitMask;
+        waits.sizeOfKeys = static_cast<uint32_t>(result.keys.size());
+        std::copy(result.keys.begin(), result.keys.end(), waits.keys);
+        return COUNT_TILES_OK;
+    }
+
+    // まとめて解く要求
+    struct Batch {
+        const CountTilesHand* hands;
+        SizeType size;
+        CountTilesWaits* results;
+        std::atomic<SizeType> next {0};     // 次に解く手牌
+        std::atomic<bool> invalid {false};  // 正しくない手牌があった
+        SizeType sizeOfWorkers {0};         // 解いているスレッドの数(mutexで守る)
+
+        // 手牌がなくなるまでChunkSize個ずつ取って解く
+        void Solve(void) {
+            for(;;) {
+                const auto first = next.fetch_add(ChunkSize);
+                if (first >= size) {
+                    break;
+                }
+
+                const auto last = std::min(first + ChunkSize, size);
+                for(auto i = first; i < last; ++i) {
+                    if (solveOne(hands[i], results[i]) != COUNT_TILES_OK) {
+                        invalid.store(true, std::memory_order_relaxed);
+                    }
+                }
+            }
+            return;
+        }
+    };
+
+    class SolverPool {
+    public:
+        explicit SolverPool(SizeType sizeOfWorkers) : stopping_(false) {
+            for(SizeType i = 0; i < sizeOfWorkers; ++i) {
+                workerSet_.push_back(THREAD_TYPE([this](void) -> void { work(); }));
+            }
+            return;
+        }
+
+        ~SolverPool(void) {
+            {
+                THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(mutex_);
+                stopping_ = true;
+            }
+            queued_.notify_all();
+            for(auto& worker : workerSet_) {
+                worker.join();
+            }
+            return;
+        }
+
+        SolverPool(const SolverPool&) = delete;
+        SolverPool& operator=(const SolverPool&) = delete;
+
+        // batchを解き終えるまで戻らない
+        void Run(Batch& batch) {
+            {
+                THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(mutex_);
+                queue_.push_back(&batch);
+                ++batch.sizeOfWorkers;
+            }
+            queued_.notify_all();
+
+            batch.Solve();
+
+            // 他のスレッドが取った手牌を解き終えるのを待つ
+            THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(mutex_);
+            release(batch);
+            while(batch.sizeOfWorkers > 0) {
+                finished_.wait(lock);
+            }
+            return;
+        }
+
+    private:
+        void work(void) {
+            THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(mutex_);
+            for(;;) {
+                if (stopping_) {
+                    break;
+                }
+                if (queue_.empty()) {
+                    queued_.wait(lock);
+                    continue;
+                }
+
+                auto& batch = *queue_.front();
+                ++batch.sizeOfWorkers;
+                lock.unlock();
+                batch.Solve();
+                lock.lock();
+                release(batch);
+            }
+            return;
+        }
+
+        // mutex_を取ってから呼ぶ
+        // batchの手牌はすべて取られたので、他のスレッドに渡さない
+        void release(Batch& batch) {
+            const auto it = std::find(queue_.begin(), queue_.end(), &batch);
+            if (it != queue_.end()) {
+                queue_.erase(it);
+            }
+
+            --batch.sizeOfWorkers;
+            if (batch.sizeOfWorkers == 0) {
+                finished_.notify_all();
+            }
+            return;
+        }
+
+        THREAD_MUTEX mutex_;
+        THREAD_CONDITION_VARIABLE queued_;    // 要求が来たか終了する
+        THREAD_CONDITION_VARIABLE finished_;  // 要求を解き終えた
+        std::deque<Batch*> queue_;
+        bool stopping_;
+        std::vector<THREAD_TYPE> workerSet_;
+    };
+
+    SolverPool& getSolverPool(void) {
+        // 要求したスレッドも解くので、論理CPUの数より一つ少なく作る
+        static SolverPool pool(std::max(static_cast<SizeType>(THREAD_HARDWARE_CONCURRENCY()),
+                                        static_cast<SizeType>(1)) - 1);
+        return pool;
+    }
+}
+
+extern "C" {
+    uint32_t CountTilesGetApiVersion(void) {
+        return COUNT_TILES_API_VERSION;
+    }
+
+    int CountTilesParseHand(const char* str, CountTilesHand* hand) {
+        if ((str == nullptr) || (hand == nullptr)) {
+            return COUNT_TILES_INVALID_ARGUMENT;
+        }
+
+        HandNumber number = 0;
+        if (!ParseHand(str, number)) {
+            return COUNT_TILES_INVALID_HAND;
+        }
+
+        *hand = number;
+        return COUNT_TILES_OK;
+    }
+
+    int CountTilesSolve(CountTilesHand hand, CountTilesWaits* result) {
+        if (result == nullptr) {
+            return COUNT_TILES_INVALID_ARGUMENT;
+        }
+        return solveOne(hand, *result);
+    }
+
+    int CountTilesSolveBatch(const CountTilesHand* hands, size_t size, CountTilesWaits* results) {
+        if ((size > 0) && ((hands == nullptr) || (results == nullptr))) {
+            return COUNT_TILES_INVALID_ARGUMENT;
+        }
+
+        Batch batch;
+        batch.hands = hands;
+        batch.size = size;
+        batch.results = results;
+
+        // 一度に取る数より少なければ、スレッドを起こさずに解く
+        if (size <= ChunkSize) {
+            batch.Solve();
+        } else {
+            getSolverPool().Run(batch);
+        }
+
+        return batch.invalid.load() ? COUNT_TILES_INVALID_HAND : COUNT_TILES_OK;
+    }
+
+    size_t CountTilesFormatWaits(CountTilesHand hand, const CountTilesWaits* waits, char* buffer, size_t size) {
+        std::string str;
+        if ((waits != nullptr) && (waits->status == COUNT_TILES_OK)) {
+            str = HandToString(hand) + ":\n";
+            PrintWaitKeys(waits->keys, std::min(static_cast<SizeType>(waits->sizeOfKeys), MaxSizeOfWaits), str);
+        }
+
+        if ((buffer != nullptr) && (size > 0)) {
+            const auto length = std::min(str.size(), static_cast<SizeType>(size - 1));
+            ::memcpy(buffer, str.data(), length);
+            buffer[length] = '\0';
+        }
+        return str.size();
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,76 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * 清一色の待ちを求めるライブラリ(libcountTilesBits)のC言語インタフェース
+ * 構造体の配置と関数の引数は、COUNT_TILES_API_VERSIONを上げない限り変えない。
+ */
+
+#ifndef COUNT_TILES_BITS_API_H
+#define COUNT_TILES_BITS_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COUNT_TILES_API_VERSION 1
+
+/* 一手牌の待ち形の数の上限 */
+#define COUNT_TILES_MAX_WAITS 32
+
+/* 返り値 */
+#define COUNT_TILES_OK 0
+#define COUNT_TILES_INVALID_HAND (-1)
+#define COUNT_TILES_INVALID_ARGUMENT (-2)
+
+/* 手牌は、13牌を1牌4bitで、小さい牌から上位に並べた値(0x1111222233334など) */
+typedef uint64_t CountTilesHand;
+
+/* 一手牌の待ち */
+typedef struct CountTilesWaits {
+    int32_t  status;      /* COUNT_TILES_OK か COUNT_TILES_INVALID_HAND */
+    uint32_t sizeOfKeys;  /* 待ち形の数 */
+    uint64_t waitMask;    /* 待ち牌の集合(1..9をbit 0..8に置く) */
+    /* 待ち形のキー。一組10bitで、bit 40..49が待ち、その下に対子、刻子、順子を大きい順に置く */
+    uint64_t keys[COUNT_TILES_MAX_WAITS];
+} CountTilesWaits;
+
+/* ライブラリのCOUNT_TILES_API_VERSIONを返す */
+uint32_t CountTilesGetApiVersion(void);
+
+/* 13牌の数字からなる文字列を手牌にする */
+int CountTilesParseHand(const char* str, CountTilesHand* hand);
+
+/* 手牌を解いてresultに格納する。呼び出したスレッドで解く。 */
+int CountTilesSolve(CountTilesHand hand, CountTilesWaits* result);
+
+/*
+ * size個の手牌を、ライブラリ内のスレッドプールで解いて、results[i]にhands[i]の待ちを格納する。
+ * 複数のスレッドから同時に呼び出してよい。正しくない手牌があれば、
+ * その手牌のstatusをCOUNT_TILES_INVALID_HANDにして、COUNT_TILES_INVALID_HANDを返す。
+ */
+int CountTilesSolveBatch(const CountTilesHand* hands, size_t size, CountTilesWaits* results);
+
+/*
+ * 手牌と待ちを、countTilesBitsと同じ形式の文字列にしてbufferに書き込む。
+ * 終端文字を除いた文字列の長さを返す。size以上なら、bufferが足りないので途中で切れている。
+ */
+size_t CountTilesFormatWaits(CountTilesHand hand, const CountTilesWaits* waits, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COUNT_TILES_BITS_API_H */
+
+/*
+Local Variables:
+mode: c
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
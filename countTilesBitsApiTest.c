@@ -0,0 +1,157 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * ライブラリのC言語インタフェースを呼び出して、結果を確かめる
+ * 引数に全手牌の結果(logBits.txtなど)を与えると、一手牌ずつ解いた結果と、
+ * まとめて解いた結果が、そのファイルと一致するかどうかも確かめる。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "countTilesBitsApi.h"
+
+static int errorCount = 0;
+
+static void expect(int condition, const char* message) {
+    if (!condition) {
+        fprintf(stderr, "Failed: %s\n", message);
+        ++errorCount;
+    }
+    return;
+}
+
+static void testSolve(void) {
+    CountTilesHand hand = 0;
+    CountTilesWaits waits;
+    char buffer[1024];
+    const char* expected =
+        "1112345678999:\n"
+        "(99)(123)(456)(789)[11]\n(99)(111)(456)(789)[23]\n(111)(999)(345)(678)[2]\n"
+        "(11)(999)(345)(678)[12]\n(11)(999)(123)(678)[45]\n(99)(111)(234)(789)[56]\n"
+        "(111)(999)(234)(678)[5]\n(11)(999)(123)(456)[78]\n(99)(111)(234)(567)[89]\n"
+        "(111)(999)(234)(567)[8]\n(11)(123)(456)(789)[99]\n";
+
+    expect(CountTilesGetApiVersion() == COUNT_TILES_API_VERSION, "API version");
+    expect(CountTilesParseHand("9998765432111", &hand) == COUNT_TILES_OK, "parse a hand");
+    expect(hand == 0x1112345678999ull, "sort a hand");
+    expect(CountTilesParseHand("1111122223333", &hand) == COUNT_TILES_INVALID_HAND, "reject five tiles");
+
+    hand = 0x1112345678999ull;
+    expect(CountTilesSolve(hand, &waits) == COUNT_TILES_OK, "solve a hand");
+    expect(waits.waitMask == 0x1ff, "wait on all tiles");
+    expect(CountTilesFormatWaits(hand, &waits, buffer, sizeof(buffer)) < sizeof(buffer), "format a hand");
+    expect(strcmp(buffer, expected) == 0, "formatted waits");
+
+    expect(CountTilesSolve(0x1111122223333ull, &waits) == COUNT_TILES_INVALID_HAND, "reject an invalid hand");
+    expect(waits.status == COUNT_TILES_INVALID_HAND, "status of an invalid hand");
+    return;
+}
+
+/* 全手牌のログを読んで、手牌の一覧と、手牌ごとの期待する文字列を作る */
+static size_t readLog(const char* path, CountTilesHand** hands, char** text, size_t** offsets) {
+    FILE* file = fopen(path, "rb");
+    size_t capacity = 1024;
+    size_t size = 0;
+    size_t length = 0;
+    long fileSize = 0;
+    char line[64];
+
+    if (file == NULL) {
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *text = malloc(fileSize + 1);
+    /* 末尾に正しくない手牌を一つ足せるようにする */
+    *hands = malloc(sizeof(CountTilesHand) * (capacity + 1));
+    *offsets = malloc(sizeof(size_t) * (capacity + 1));
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        const size_t lineLength = strlen(line);
+        char* colon = strchr(line, ':');
+        if (colon != NULL) {
+            if (size >= capacity) {
+                capacity *= 2;
+                *hands = realloc(*hands, sizeof(CountTilesHand) * (capacity + 1));
+                *offsets = realloc(*offsets, sizeof(size_t) * (capacity + 1));
+            }
+            *colon = '\0';
+            CountTilesParseHand(line, &(*hands)[size]);
+            *colon = ':';
+            (*offsets)[size] = length;
+            ++size;
+        }
+        memcpy(*text + length, line, lineLength);
+        length += lineLength;
+    }
+
+    (*offsets)[size] = length;
+    fclose(file);
+    return size;
+}
+
+static void testBatch(const char* path) {
+    CountTilesHand* hands = NULL;
+    char* text = NULL;
+    size_t* offsets = NULL;
+    const size_t size = readLog(path, &hands, &text, &offsets);
+    CountTilesWaits* results = malloc(sizeof(CountTilesWaits) * (size + 1));
+    size_t mismatch = 0;
+    size_t i;
+    char buffer[1024];
+
+    expect(size > 0, "read the log");
+    expect(CountTilesSolveBatch(hands, size, results) == COUNT_TILES_OK, "solve all hands");
+
+    for(i = 0; i < size; ++i) {
+        const size_t expectedLength = offsets[i + 1] - offsets[i];
+        CountTilesWaits waits;
+        CountTilesSolve(hands[i], &waits);
+        if ((waits.waitMask != results[i].waitMask) || (waits.sizeOfKeys != results[i].sizeOfKeys) ||
+            (memcmp(waits.keys, results[i].keys, sizeof(waits.keys[0]) * waits.sizeOfKeys) != 0) ||
+            (CountTilesFormatWaits(hands[i], &results[i], buffer, sizeof(buffer)) != expectedLength) ||
+            (memcmp(buffer, text + offsets[i], expectedLength) != 0)) {
+            ++mismatch;
+        }
+    }
+    expect(mismatch == 0, "batch results match the log");
+
+    /* 正しくない手牌が混ざっても、他の手牌は解く */
+    if (size > 100) {
+        hands[size] = 0x1111122223333ull;
+        expect(CountTilesSolveBatch(hands + size - 100, 101, results) == COUNT_TILES_INVALID_HAND,
+               "batch with an invalid hand");
+        expect((results[99].status == COUNT_TILES_OK) && (results[100].status == COUNT_TILES_INVALID_HAND),
+               "status in a batch");
+    }
+
+    printf("%lu hands, %lu mismatches\n", (unsigned long)size, (unsigned long)mismatch);
+    free(results);
+    free(offsets);
+    free(text);
+    free(hands);
+    return;
+}
+
+int main(int argc, char* argv[]) {
+    testSolve();
+    if (argc > 1) {
+        testBatch(argv[1]);
+    }
+
+    printf("%s\n", (errorCount == 0) ? "All tests passed" : "Some tests failed");
+    return (errorCount == 0) ? 0 : 1;
+}
+
+/*
+Local Variables:
+mode: c
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
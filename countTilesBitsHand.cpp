@@ -0,0 +1,199 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * 手牌の表現を変換する
+ * 手牌の番号(rank)は、EnumerateAllが列挙する順番(辞書順)で、先頭の1111222233334を0とする
+ */
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include "countTilesBits.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    constexpr SizeType SizeOfHandTiles = SizeOfCompleteTiles - 1;  // 手牌の数
+    constexpr SizeType SizeOfBitsPerDigit = 4;                     // 手牌の番号の1牌あたりのbit数
+
+    // 数字digit..9から、各4牌以下でsize牌を選ぶ組み合わせの数
+    class CombinationTable {
+    public:
+        CombinationTable(void) {
+            for(SizeType digit = TileMax + 1; digit >= TileMin; --digit) {
+                for(SizeType size = 0; size <= SizeOfHandTiles; ++size) {
+                    SizeType count = 0;
+                    if (size == 0) {
+                        count = 1;
+                    } else if (digit <= TileMax) {
+                        for(SizeType n = 0; (n <= SizeOfOneTile) && (n <= size); ++n) {
+                            count += table_[digit + 1][size - n];
+                        }
+                    }
+                    table_[digit][size] = count;
+                }
+            }
+        }
+
+        // 数字digitをすでにused牌使ったとして、残りsize牌をdigit..9から選ぶ組み合わせの数
+        SizeType Count(SizeType digit, SizeType used, SizeType size) const {
+            SizeType count = 0;
+            for(SizeType n = 0; ((used + n) <= SizeOfOneTile) && (n <= size); ++n) {
+                count += table_[digit + 1][size - n];
+            }
+            return count;
+        }
+
+    private:
+        std::array<std::array<SizeType, SizeOfHandTiles + 1>, TileMax + 2> table_;
+    };
+
+    const CombinationTable& getCombinationTable(void) {
+        static const CombinationTable table;
+        return table;
+    }
+
+    // 先頭からindex番目(0が先頭)の牌を返す
+    inline SizeType getDigit(HandNumber number, SizeType index) {
+        return (number >> ((SizeOfHandTiles - 1 - index) * SizeOfBitsPerDigit)) & 0xf;
+    }
+}
+
+namespace TileSetSolver {
+    bool ParseHand(const std::string& str, HandNumber& number) {
+        std::array<SizeType, TileMax + 1> countSet {};
+        SizeType size = 0;
+
+        for(auto c : str) {
+            if ((c < '1') || (c > '9')) {
+                return false;
+            }
+            const SizeType digit = c - '0';
+            if ((++countSet[digit] > SizeOfOneTile) || (++size > SizeOfHandTiles)) {
+                return false;
+            }
+        }
+
+        if (size != SizeOfHandTiles) {
+            return false;
+        }
+
+        // 並べ替えて小さい牌から上位に詰める
+        number = 0;
+        for(SizeType digit = TileMin; digit <= TileMax; ++digit) {
+            for(SizeType n = 0; n < countSet[digit]; ++n) {
+                number = (number << SizeOfBitsPerDigit) | digit;
+            }
+        }
+
+        return true;
+    }
+
+    bool IsValidHand(HandNumber number) {
+        if (number >> (SizeOfHandTiles * SizeOfBitsPerDigit)) {
+            return false;
+        }
+
+        // 牌は1..9で、小さい順に並び、同じ牌は4牌以下
+        SizeType prevDigit = TileMin;
+        SizeType used = 0;
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            const auto digit = getDigit(number, index);
+            if ((digit < prevDigit) || (digit > TileMax)) {
+                return false;
+            }
+
+            used = (digit == prevDigit) ? (used + 1) : 1;
+            if (used > SizeOfOneTile) {
+                return false;
+            }
+            prevDigit = digit;
+        }
+
+        return true;
+    }
+
+    std::string HandToString(HandNumber number) {
+        std::string str;
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            str += static_cast<char>('0' + getDigit(number, index));
+        }
+        return str;
+    }
+
+    SizeType GetHandRank(HandNumber number) {
+        const auto& table = getCombinationTable();
+        SizeType rank = 0;
+        SizeType prevDigit = TileMin;
+        SizeType used = 0;
+
+        // 先頭から一牌ずつ、より小さい牌を置いた手牌の数を足す
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            const auto digit = getDigit(number, index);
+            const auto rest = SizeOfHandTiles - 1 - index;
+            for(auto smaller = prevDigit; smaller < digit; ++smaller) {
+                const auto smallerUsed = (smaller == prevDigit) ? used : 0;
+                if (smallerUsed < SizeOfOneTile) {
+                    rank += table.Count(smaller, smallerUsed + 1, rest);
+                }
+            }
+
+            used = (digit == prevDigit) ? (used + 1) : 1;
+            prevDigit = digit;
+        }
+
+        return rank;
+    }
+
+    HandNumber GetHandNumber(SizeType rank) {
+        const auto& table = getCombinationTable();
+        HandNumber number = 0;
+        SizeType prevDigit = TileMin;
+        SizeType used = 0;
+
+        // 先頭から一牌ずつ、rankを超えない最大の牌を選ぶ
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            const auto rest = SizeOfHandTiles - 1 - index;
+            SizeType digit = prevDigit;
+            for(; digit <= TileMax; ++digit) {
+                const auto digitUsed = (digit == prevDigit) ? used : 0;
+                if (digitUsed >= SizeOfOneTile) {
+                    continue;
+                }
+
+                const auto count = table.Count(digit, digitUsed + 1, rest);
+                if (rank < count) {
+                    break;
+                }
+                rank -= count;
+            }
+
+            used = (digit == prevDigit) ? (used + 1) : 1;
+            prevDigit = digit;
+            number = (number << SizeOfBitsPerDigit) | digit;
+        }
+
+        return number;
+    }
+
+    TileMap HandToTileMap(HandNumber number) {
+        TileMap tileMap = 0;
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            // 同じ牌は下位から詰めて、牌の数を1の並びで表す
+            const auto shift = (getDigit(number, index) - TileMin) * SizeOfBitsPerTile;
+            const TileMap fieldMask = static_cast<TileMap>(0x1f) << shift;
+            tileMap |= (((tileMap >> shift) + 1) << shift) & fieldMask;
+        }
+        return tileMap;
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
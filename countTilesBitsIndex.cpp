@@ -0,0 +1,171 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * 待ち牌と待ち形から手牌を逆引きする索引
+ * 待ち牌、待ち形の種類、待ち形ごとに、手牌の順番をSizeOfAllHands bitのビット列に置く。
+ * 問い合わせはビット列の積、和、差だけで答えるので、手牌を解き直さない。
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    // 待ち形の一組のキーの幅
+    constexpr TileKey KeyMask = (1 << SizeOfKeyBits) - 1;
+    // 最上位の組が待ち形
+    constexpr SizeType OpenKeyShift = SizeOfKeyBits * (SizeOfTileSet - 1);
+}
+
+namespace TileSetSolver {
+    HandSet::HandSet(void) : words_() {
+        return;
+    }
+
+    void HandSet::Add(SizeType rank) {
+        words_[rank / 64] |= static_cast<uint64_t>(1) << (rank % 64);
+        return;
+    }
+
+    bool HandSet::Contains(SizeType rank) const {
+        return (words_[rank / 64] >> (rank % 64)) & 1;
+    }
+
+    SizeType HandSet::Count(void) const {
+        SizeType count = 0;
+        for(auto word : words_) {
+            count += __builtin_popcountll(word);
+        }
+        return count;
+    }
+
+    HandSet& HandSet::operator&=(const HandSet& other) {
+        for(SizeType i = 0; i < SizeOfWords; ++i) {
+            words_[i] &= other.words_[i];
+        }
+        return *this;
+    }
+
+    HandSet& HandSet::operator|=(const HandSet& other) {
+        for(SizeType i = 0; i < SizeOfWords; ++i) {
+            words_[i] |= other.words_[i];
+        }
+        return *this;
+    }
+
+    HandSet& HandSet::AndNot(const HandSet& other) {
+        for(SizeType i = 0; i < SizeOfWords; ++i) {
+            words_[i] &= ~other.words_[i];
+        }
+        return *this;
+    }
+
+    HandIndex::HandIndex(const WaitTableView& view) {
+        // 待ち形は高々数十種類なので、キーで並べずに見つけた順に置く
+        std::vector<TileKey> openKeyValueSet;
+        for(SizeType rank = 0; rank < SizeOfAllHands; ++rank) {
+            const auto waitMask = view.GetWaitMask(rank);
+            if (waitMask) {
+                tenpaiSet_.Add(rank);
+            }
+
+            for(SizeType tile = TileMin; tile <= TileMax; ++tile) {
+                if ((waitMask >> (tile - TileMin)) & 1) {
+                    waitTileSet_[tile].Add(rank);
+                }
+            }
+
+            const auto keys = view.GetKeys(rank);
+            const auto size = view.GetSizeOfKeys(rank);
+            for(SizeType i = 0; i < size; ++i) {
+                const auto openKey = (keys[i] >> OpenKeyShift) & KeyMask;
+                waitShapeSet_[GetWaitShape(openKey)].Add(rank);
+
+                const auto it = std::find(openKeyValueSet.begin(), openKeyValueSet.end(), openKey);
+                const SizeType index = it - openKeyValueSet.begin();
+                if (it == openKeyValueSet.end()) {
+                    openKeyValueSet.push_back(openKey);
+                    openKeyNameSet_.push_back(OpenKeyToString(openKey));
+                    openKeySet_.push_back(HandSet());
+                }
+                openKeySet_.at(index).Add(rank);
+            }
+        }
+
+        return;
+    }
+
+    bool HandIndex::Query(const std::string& expr, HandSet& result) const {
+        result = HandSet();
+        char op = '|';
+        std::string term;
+        for(SizeType i = 0; i <= expr.size(); ++i) {
+            const char c = (i < expr.size()) ? expr[i] : '\0';
+            if (c == ' ') {
+                continue;
+            }
+
+            if ((c != '&') && (c != '|') && (c != '-') && (c != '\0')) {
+                term += c;
+                continue;
+            }
+
+            const auto termSet = findTerm(term);
+            if (!termSet) {
+                return false;
+            }
+
+            if (op == '&') {
+                result &= *termSet;
+            } else if (op == '|') {
+                result |= *termSet;
+            } else {
+                result.AndNot(*termSet);
+            }
+
+            op = c;
+            term.clear();
+        }
+
+        return true;
+    }
+
+    const HandSet* HandIndex::findTerm(const std::string& term) const {
+        if ((term.size() == 1) && (term[0] >= '1') && (term[0] <= '9')) {
+            return &waitTileSet_[term[0] - '0'];
+        }
+
+        if (term == "tenpai") {
+            return &tenpaiSet_;
+        }
+
+        for(SizeType shape = 0; shape < SizeOfWaitShapes; ++shape) {
+            if (term == GetWaitShapeName(static_cast<WaitShape>(shape))) {
+                return &waitShapeSet_[shape];
+            }
+        }
+
+        // 待ち形は[1]から[99]の形式で、どの手牌にもない待ち形なら空集合
+        if ((term.size() < 3) || (term.size() > 4) || (term.front() != '[') || (term.back() != ']') ||
+            (term.find_first_not_of("123456789", 1) != (term.size() - 1))) {
+            return nullptr;
+        }
+
+        const auto it = std::find(openKeyNameSet_.begin(), openKeyNameSet_.end(), term);
+        return (it != openKeyNameSet_.end()) ? &openKeySet_.at(it - openKeyNameSet_.begin()) : &emptySet_;
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
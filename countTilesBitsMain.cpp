@@ -4,54 +4,234 @@
  *
  * 清一色の全組み合わせについて、すべての待ちを1秒台で結果を出力する
  * 起動時の引数に-N2をつけると2スレッドで、-NをつけるとCPUの論理スレッド数の
- * スレッドを使って解く。
+ * スレッドを使って解く。-vをつけると、解くのに要したヒープ確保の回数を標準エラー出力に書き出す。
+ * --verifyをつけると、countTiles.cpp の実装と結果が一致するかどうかを調べる。
+ * --cpus=0,2-3 をつけるとスレッドを指定した論理CPUに順に固定し、--physical-coresをつけると
+ * 物理コアごとに一つの論理CPUだけを使う。--numa-localをつけると、各スレッドの結果を
+ * そのスレッドが動くNUMAノードのメモリに置く(--cpusか--physical-coresで固定したときだけ使える)。
+ * これらは既定の出力のスレッドだけを配置する。
+ * --server=path をつけると、Unixドメインソケットpathで待ちの問い合わせを受け付ける。
+ * --client=path をつけると、そのサーバにランダムな手牌を問い合わせて遅延時間を測る。
+ * --emit-table=file をつけると、全手牌の待ちの表をfileに書き出す(実行ファイルに埋め込む表を作る)。
+ * --query をつけると、標準入力から一行に一つずつ手牌を読んで、埋め込んだ表から待ちを引いて書き出す。
+ * --cache=file をつけると、fileにある全手牌の待ちの表をmmapして書き出す。fileがないか古ければ、
+ * 解いた結果をfileに書いてから書き出す。
+ * --waits-only をつけると、分解を書き出さずに、手牌ごとに待ち牌だけを一行で書き出す。
+ * --stats をつけると、手牌ごとの結果は書き出さずに、待ちの集計だけを書き出す。
+ * --wait=25, --with=111, --min-forms=n, --max-forms=n, --tenpai をつけると、条件を満たす手牌だけを書き出す。
+ * 条件は既定の出力、--pipeline、--cache、--waits-only(待ち形の数の条件を除く)で使える。
+ * --index="5&8" をつけると、待ち牌と待ち形の索引を引いて、式を満たす手牌を書き出す。
+ * --index-bench をつけると、索引を作る時間と引く時間を測る。
+ * --pipeline をつけると、手牌を作る段、解く段(-Nのスレッド数)、書き出す段を並行して動かす。
+ * --queue-depth=n, --batch-size=n で段の間のリングバッファの長さと、一度に渡す手牌の数を決める。
+ * --from=n, --to=n をつけると、手牌の順番(または13牌の手牌)がfrom以上to未満の手牌だけを解く。
+ * --shard=i/N をつけると、範囲をN等分したi番目(先頭は0)だけを解く。範囲を指定すると、
+ * 結果の前後に範囲と手牌の数を#で始まる行で書き出す(countTilesMergeShards.rbでつなぐ)。範囲は既定の出力だけで使える。
+ * --latency をつけると、手牌ごとに解く時間の分位点を、待ち牌の数と試した(待ち, 対子)の数ごとに標準エラー出力に書き出す。
+ * 測るのは待ちを求める処理だけで、絞り込みと文字列化は含まない。表を作るときや問い合わせでも測る。
+ * --perf をつけると、スレッドと区間(列挙、分解、絞り込み、文字列化、書き出し)ごとに、サイクル数、命令数、
+ * 分岐予測ミス、L1データキャッシュミスを数えて、IPCと一緒に標準エラー出力に書き出す。
+ * --huge-pages をつけると、各スレッドの結果を手牌ごとのstd::stringではなく、スレッドごとに一つの
+ * 連続した領域(できればヒュージページ)に置く。
  */
 
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
 #include <vector>
 #include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
 
-#ifdef USE_BOOST_THREAD
-// MinGWではstd::threadが使えないので、boost::threadを使う
-#include <boost/thread/future.hpp>
-#define THREAD_FUTURE boost::unique_future
-#define THREAD_ASYNC  boost::async
-#define THREAD_LAUNCH_ASYNC  boost::launch::async
-#define THREAD_HARDWARE_CONCURRENCY  boost::thread::hardware_concurrency
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #else
-#include <future>
-#define THREAD_FUTURE std::future
-#define THREAD_ASYNC  std::async
-#define THREAD_LAUNCH_ASYNC std::launch::async
-#define THREAD_HARDWARE_CONCURRENCY  std::thread::hardware_concurrency
+#include <process.h>
 #endif
 
 using namespace TileSetSolver;
 
 namespace {
-    void solveAllInSingleThread(std::ostream& os) {
+    // 実行するスレッド数
+    using SizeOfThreads = unsigned int;
+
+    // 起動時の引数
+    struct Options {
+        SizeOfThreads sizeOfThreads {1};  // 実行するスレッド数
+        bool verbose {false};             // 実行時の情報を標準エラー出力に書き出す
+        bool verify {false};              // 二つの実装の結果を比べる
+        bool sizeOfThreadsSpecified {false};  // スレッド数を数で指定した
+        std::vector<int> cpuSet;          // スレッドを固定する論理CPU(空なら固定しない)
+        bool physicalCores {false};       // 物理コアごとに一つの論理CPUだけを使う
+        bool numaLocal {false};           // 結果をスレッドが動くNUMAノードに置く
+        bool placed {false};              // スレッドの配置を指定した
+        std::string serverPath;           // 問い合わせを受け付けるソケット
+        std::string clientPath;           // 問い合わせるソケット
+        SizeType sizeOfRequests {100000}; // 問い合わせる手牌の数
+        bool shutdownServer {false};      // 問い合わせた後にサーバを終了させる
+        std::string tablePath;            // 全手牌の待ちの表を書き出すファイル
+        bool query {false};               // 標準入力の手牌の待ちを表から引く
+        std::string cachePath;            // 全手牌の待ちの表を置くファイル
+        bool waitsOnly {false};           // 待ち牌だけを書き出す
+        bool stats {false};               // 待ちの集計だけを書き出す
+        HandFilter filter;                // 書き出す手牌の条件
+        bool filtered {false};            // 書き出す手牌の条件を指定した
+        bool formsFiltered {false};       // 待ち形の数の条件を指定した
+        std::string indexQuery;           // 索引を引く式
+        bool indexBench {false};          // 索引を引く時間を測る
+        bool pipeline {false};            // 段に分けて並行して解く
+        PipelineConfig pipelineConfig;    // 段に分けて解くときの設定
+        HandRange range;                  // 解く手牌の範囲
+        bool ranged {false};              // 範囲を指定した
+        SizeType shardIndex {0};          // 範囲を分けたうちの何番目を解くか
+        SizeType sizeOfShards {1};        // 範囲をいくつに分けるか
+        bool latency {false};             // 手牌ごとに解く時間を測る
+        bool perf {false};                // 性能カウンタを区間ごとに数える
+        bool hugePages {false};           // 結果をスレッドごとに一つの連続した領域に置く
+    };
+
+    // 解いた結果の情報
+    struct SolverReport {
+        SizeType sizeOfHands {0};           // 手牌の数
+        std::vector<std::string> placementSet;  // スレッドごとの配置
+    };
+
+    // index番目のスレッドを配置して、配置を文字列で返す
+    std::string placeWorker(const Options& options, SizeType index) {
+        std::ostringstream os;
+        os << "worker " << index << " : ";
+
+        if (options.cpuSet.empty()) {
+            os << "not pinned";
+        } else {
+            const auto cpu = options.cpuSet.at(index % options.cpuSet.size());
+            const auto placement = GetCpuPlacement(cpu);
+            os << "cpu " << cpu << " (package " << placement.package << ", core " << placement.core
+               << ", node " << placement.node << ")";
+            if (!PinCurrentThread(cpu)) {
+                os << " pinning failed";
+            }
+        }
+
+        if (options.numaLocal) {
+            os << (UseLocalMemory() ? ", local memory" : ", local memory not available");
+        }
+
+        return os.str();
+    }
+
+    // 範囲をsizeOfThreads等分したindex番目の連続した範囲を返す
+    // 絞り込むとスレッドごとに残る手牌の数が異なるので、一つおきではなく連続した範囲に分けて、結果を順につなぐ
+    HandRange getWorkerRange(const HandRange& range, SizeType index, SizeType sizeOfThreads) {
+        HandRange workerRange;
+        workerRange.first = range.first + range.size() * index / sizeOfThreads;
+        workerRange.last = range.first + range.size() * (index + 1) / sizeOfThreads;
+        return workerRange;
+    }
+
+    // index番目のスレッドとして配置を決めてから解く
+    void solvePart(const Options& options, SizeType index, SizeType sizeOfThreads,
+                   StrArray& result, std::string& placement) {
+        placement = placeWorker(options, index);
+        const auto range = getWorkerRange(options.range, index, sizeOfThreads);
+        // 結果の配列をこのスレッドで一度だけ確保する。--numa-localならこのスレッドのNUMAノードに置かれる。
+        result.reserve(range.size());
+        EnumerateRange(range, 0, 1, options.filter, result);
+        return;
+    }
+
+    // 一手牌の結果の文字列の長さの見込み(全手牌の平均は約45byte)。足りなければ領域を広げる。
+    constexpr SizeType EstimatedBytesPerHand = 64;
+
+    // index番目のスレッドとして配置を決めてから、結果をこのスレッドが確保した領域に置いて解く
+    // 最初に書き込むのはこのスレッドなので、--numa-localならこのスレッドのNUMAノードに置かれる
+    void solvePartInBuffer(const Options& options, SizeType index, SizeType sizeOfThreads,
+                           std::unique_ptr<ResultBuffer>& result, std::string& placement) {
+        placement = placeWorker(options, index);
+        const auto range = getWorkerRange(options.range, index, sizeOfThreads);
+        const SizeType sizeOfHands = range.size();
+        result.reset(new ResultBuffer(sizeOfHands * EstimatedBytesPerHand, sizeOfHands));
+        EnumerateRange(range, 0, 1, options.filter, *result);
+        placement += std::string(", results on ") + ResultBuffer::GetBackingName(result->GetBacking());
+        return;
+    }
+
+    // 各スレッドの結果を、手牌ごとのstd::stringではなく、スレッドごとに一つの連続した領域に置く
+    void solveAllInBuffers(const Options& options, std::ostream& os, SolverReport& report) {
+        const SizeType sizeOfThreads = std::max(options.sizeOfThreads, static_cast<SizeOfThreads>(1));
+        std::vector<std::unique_ptr<ResultBuffer>> resultSet(sizeOfThreads);
+        report.placementSet.resize(sizeOfThreads);
+
+        if (sizeOfThreads == 1) {
+            solvePartInBuffer(options, 0, 1, resultSet.at(0), report.placementSet.at(0));
+        } else {
+            std::vector<THREAD_FUTURE<void>> futureSet;
+            for(SizeType index = 0; index < sizeOfThreads; ++index) {
+                futureSet.push_back(
+                    THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                                 [&options, &resultSet, &report, index, sizeOfThreads](void) -> void
+                                 { solvePartInBuffer(options, index, sizeOfThreads, resultSet.at(index),
+                                                     report.placementSet.at(index)); }));
+            }
+            for(auto& f : futureSet) {
+                f.get();
+            }
+        }
+
+        for(auto& result : resultSet) {
+            report.sizeOfHands += result->size();
+        }
+
+        // 各スレッドの領域は書き出す順に並んでいるので、スレッドの順に一度ずつ書き出す
+        const auto perfCollector = StartPerfCounters("output", PerfOutput);
+        for(auto& result : resultSet) {
+            os.write(result->GetData(0), result->GetSizeOfBytes());
+        }
+
+        return;
+    }
+
+    void solveAllInSingleThread(const Options& options, std::ostream& os, SolverReport& report) {
         StrArray result;
-        EnumerateAll(0, 1, result);
-        for(auto str : result) {
+        report.placementSet.resize(1);
+        solvePart(options, 0, 1, result, report.placementSet.at(0));
+
+        const auto perfCollector = StartPerfCounters("output", PerfOutput);
+        for(auto& str : result) {
             os << str;
         }
+
+        report.sizeOfHands = result.size();
         return;
     }
 
-    void solveAllWithThreads(SizeType sizeOfThreads, std::ostream& os) {
+    void solveAllWithThreads(const Options& options, std::ostream& os, SolverReport& report) {
+        const SizeType sizeOfThreads = options.sizeOfThreads;
         std::vector<StrArray> resultSet;
         resultSet.resize(sizeOfThreads);
+        report.placementSet.resize(sizeOfThreads);
 
         // 並行して評価する関数群を準備する
         std::vector<THREAD_FUTURE<void>> futureSet;
-        for(decltype(sizeOfThreads) index = 0; index < sizeOfThreads; ++index) {
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
             futureSet.push_back(
                 THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
-                             [&resultSet, index, sizeOfThreads](void) -> void
-                             { EnumerateAll(index, sizeOfThreads, resultSet.at(index)); }));
+                             [&options, &resultSet, &report, index, sizeOfThreads](void) -> void
+                             { solvePart(options, index, sizeOfThreads, resultSet.at(index),
+                                         report.placementSet.at(index)); }));
         }
 
         // 並行して評価して、結果がそろうのを待つ
@@ -59,32 +239,177 @@ namespace {
             f.get();
         }
 
-        // 並行実行結果から、順番に結果を取得する
-        bool cont = true;
-        for(decltype(resultSet)::value_type::size_type i = 0; cont; ++i) {
-            for(auto& result : resultSet) {
-                if (result.size() <= i) {
-                    cont = false;
-                    break;
+        for(auto& result : resultSet) {
+            report.sizeOfHands += result.size();
+        }
+
+        // 並行実行結果を、スレッドの順につなぐ
+        const auto perfCollector = StartPerfCounters("output", PerfOutput);
+        for(auto& result : resultSet) {
+            for(auto& str : result) {
+                os << str;
+            }
+        }
+
+        return;
+    }
+
+    // 手牌ごとに解く時間の分位点をマイクロ秒で書き出す
+    void printSolveLatency(const SolveLatency& latency, std::ostream& os) {
+        const auto printRow = [&os](const std::string& name, const LatencyHistogram& histogram) {
+            if (histogram.GetCount() == 0) {
+                return;
+            }
+            os << std::left << std::setw(14) << name << std::right << std::setw(7) << histogram.GetCount();
+            for(auto percentile : {50.0, 90.0, 99.0, 99.9}) {
+                os << std::setw(9) << (static_cast<double>(histogram.GetPercentile(percentile)) / 1000.0);
+            }
+            os << std::setw(9) << (static_cast<double>(histogram.GetMax()) / 1000.0) << "\n";
+        };
+
+        os << std::fixed << std::setprecision(2)
+           << "solve latency (usec)  count      p50      p90      p99    p99.9      max\n";
+        printRow("all", latency.all);
+        for(SizeType waits = 0; waits < latency.byWaits.size(); ++waits) {
+            printRow("waits=" + std::to_string(waits), latency.byWaits[waits]);
+        }
+
+        for(SizeType branchClass = 0; branchClass < SizeOfBranchClasses; ++branchClass) {
+            const SizeType lower = branchClass * BranchClassWidth;
+            std::string name = "branches=" + std::to_string(lower) + "-";
+            if ((branchClass + 1) < SizeOfBranchClasses) {
+                name += std::to_string(lower + BranchClassWidth - 1);
+            }
+            printRow(name, latency.byBranches[branchClass]);
+        }
+
+        os << std::defaultfloat;
+        return;
+    }
+
+    // スレッドと区間ごとに数えた性能カウンタと、それらから求めたIPCなどを書き出す
+    void printPerfCounters(std::vector<PerfThreadCount> countSet, std::ostream& os) {
+        if (countSet.empty()) {
+            os << "perf counters: nothing counted\n";
+            return;
+        }
+
+        std::sort(countSet.begin(), countSet.end(),
+                  [](const PerfThreadCount& lhs, const PerfThreadCount& rhs) { return lhs.name < rhs.name; });
+
+        // 全スレッドの合計
+        PerfThreadCount total = countSet.front();
+        total.name = "all";
+        for(auto& values : total.values) {
+            values.fill(0);
+        }
+        for(const auto& count : countSet) {
+            for(SizeType phase = 0; phase < SizeOfPerfPhases; ++phase) {
+                for(SizeType event = 0; event < SizeOfPerfEvents; ++event) {
+                    total.available[event] = total.available[event] && count.available[event];
+                    total.values[phase][event] += count.values[phase][event];
                 }
-                os << result.at(i);
             }
         }
+        countSet.push_back(total);
+
+        // 数えられなかった値はn/aにする
+        const auto printValue = [&os](bool available, double value, int width) {
+            if (available) {
+                os << std::setw(width) << value;
+            } else {
+                os << std::setw(width) << "n/a";
+            }
+        };
+
+        os << std::fixed << std::setprecision(2)
+           << "perf counters     phase         msec   Mcycles    Minstr    IPC  brmiss/Ki  L1Dmiss/Ki\n";
+        for(const auto& count : countSet) {
+            const auto& available = count.available;
+            for(SizeType phase = 0; phase < SizeOfPerfPhases; ++phase) {
+                const auto& values = count.values[phase];
+                if (std::all_of(values.begin(), values.end(), [](uint64_t value) { return value == 0; })) {
+                    continue;
+                }
 
+                const double instructions = static_cast<double>(values[PerfInstructions]);
+                const double kiloInstructions = std::max(instructions / 1000.0, 1.0);
+                const bool hasInstructions = available[PerfInstructions] && (values[PerfInstructions] > 0);
+                os << std::left << std::setw(18) << count.name << std::setw(10)
+                   << GetPerfPhaseName(static_cast<PerfPhase>(phase)) << std::right;
+                printValue(available[PerfTaskClock], static_cast<double>(values[PerfTaskClock]) / 1e6, 8);
+                printValue(available[PerfCycles], static_cast<double>(values[PerfCycles]) / 1e6, 10);
+                printValue(available[PerfInstructions], instructions / 1e6, 10);
+                printValue(hasInstructions && available[PerfCycles] && (values[PerfCycles] > 0),
+                           instructions / static_cast<double>(std::max(values[PerfCycles], static_cast<uint64_t>(1))), 7);
+                printValue(hasInstructions && available[PerfBranchMisses],
+                           static_cast<double>(values[PerfBranchMisses]) / kiloInstructions, 11);
+                printValue(hasInstructions && available[PerfL1dMisses],
+                           static_cast<double>(values[PerfL1dMisses]) / kiloInstructions, 12);
+                os << "\n";
+            }
+
+            if (count.multiplexed) {
+                os << count.name << ": counters were shared with other users and only partly counted\n";
+            }
+        }
+
+        uint64_t switches = 0;
+        for(const auto& count : countSet) {
+            switches += (count.name == "all") ? 0 : count.switches;
+        }
+        os << "phase switches: " << switches << " (the cost of reading counters is subtracted)\n";
+        os << std::defaultfloat;
         return;
     }
 
-    void SolveAll(SizeType sizeOfThreads, std::ostream& os) {
-        if (sizeOfThreads <= 1) {
-            solveAllInSingleThread(os);
+    void SolveAll(const Options& options, std::ostream& os) {
+        SolverReport report;
+        const SizeType allocationsBefore = GetAllocationCount();
+
+        // 範囲を指定したら、つなぐときに確かめられるように、範囲と手牌の数を前後に書く
+        if (options.ranged) {
+            os << "# countTilesBits shard=" << options.shardIndex << "/" << options.sizeOfShards
+               << " first=" << options.range.first << " last=" << options.range.last
+               << " total=" << SizeOfAllHands << "\n";
+        }
+
+        if (options.hugePages) {
+            solveAllInBuffers(options, os, report);
+        } else if (options.sizeOfThreads <= 1) {
+            solveAllInSingleThread(options, os, report);
         } else {
-            solveAllWithThreads(sizeOfThreads, os);
+            solveAllWithThreads(options, os, report);
+        }
+
+        if (options.ranged) {
+            os << "# end hands=" << report.sizeOfHands << "\n";
+        }
+
+        if (options.perf) {
+            printPerfCounters(GetPerfCounters(), std::cerr);
+        }
+
+        if (options.verbose) {
+            const SizeType allocations = GetAllocationCount() - allocationsBefore;
+            const SizeType sizeOfHands = std::max(report.sizeOfHands, static_cast<SizeType>(1));
+            std::cerr << "threads: " << options.sizeOfThreads << "\n";
+            for(auto& placement : report.placementSet) {
+                std::cerr << placement << "\n";
+            }
+            std::cerr << "hands: " << report.sizeOfHands << "\n"
+                      << "allocations: " << allocations << " ("
+                      << (static_cast<double>(allocations) / static_cast<double>(sizeOfHands))
+                      << " per hand, including result strings)\n";
+            const auto pruneCount = GetPruneCount();
+            std::cerr << "pairs: " << pruneCount.tried << " tried, " << pruneCount.pruned
+                      << " pruned before splitting\n";
         }
+
         return;
     }
 
     // 実行するスレッド数を返す
-    using SizeOfThreads = unsigned int;
     SizeOfThreads GetSizeOfThreads(const char* pArg) {
 #ifdef __CYGWIN__
         // Cygwinでマルチスレッド実行すると却って遅くなる
@@ -93,10 +418,6 @@ namespace {
         std::string arg = pArg;
         std::string opt = "-N";
 
-        if (arg.find(opt) != 0) {
-            return 1;
-        }
-
         if (arg.size() > opt.size()) {
             auto n = atoi(pArg + opt.size());
             if (n > 0) {
@@ -107,12 +428,709 @@ namespace {
         return THREAD_HARDWARE_CONCURRENCY();
 #endif
     }
+
+    void printUsage(std::ostream& os) {
+        os << "Usage: countTilesBits [options]\n"
+           << "  -N[number]        solve with threads (default: logical CPUs)\n"
+           << "  -v                print statistics to stderr\n"
+           << "  --verify          compare results with the CountTiles engine\n"
+           << "  --cpus=list       pin threads to CPUs (e.g. 0,2,4-6)\n"
+           << "  --physical-cores  use one logical CPU per physical core\n"
+           << "  --numa-local      place results on the local NUMA node\n"
+           << "  --server=path     answer queries on a Unix domain socket\n"
+           << "  --client=path     send random queries to a server and measure latency\n"
+           << "  --requests=number number of queries sent by --client\n"
+           << "  --shutdown        stop the server after --client finishes\n"
+           << "  --emit-table=file write the table of all waits to a file\n"
+           << "  --query           read hands from stdin and look up their waits\n"
+           << "  --cache=file      print all waits from a table file, creating it if needed\n"
+           << "  --waits-only      print only the winning tiles of each hand\n"
+           << "  --stats           print statistics of all hands instead of each hand\n"
+           << "  --wait=tiles      print hands waiting on all of the tiles (e.g. 25)\n"
+           << "  --with=tiles      print hands containing the tiles (e.g. 111)\n"
+           << "  --min-forms=n     print hands with at least n wait forms\n"
+           << "  --max-forms=n     print hands with at most n wait forms\n"
+           << "  --tenpai          print hands with at least one winning tile\n"
+           << "  --index=expr      print hands matching an expression (e.g. \"5&8\", \"sides|edge\", \"[1]&[4]\")\n"
+           << "  --index-bench     measure building and querying the index\n"
+           << "  --pipeline        overlap generating, solving (-N threads) and writing hands\n"
+           << "  --queue-depth=n   length of ring buffers between pipeline stages (default: 16)\n"
+           << "  --batch-size=n    hands passed at a time between pipeline stages (default: 256, max: 1024)\n"
+           << "  --from=n          solve hands from rank n or a 13-tile hand (inclusive)\n"
+           << "  --to=n            solve hands up to rank n or a 13-tile hand (exclusive)\n"
+           << "  --shard=i/N       solve the i-th (0-based) of N equal parts of the range\n"
+           << "  --latency         print percentiles of the time to solve each hand to stderr\n"
+           << "  --perf            count cycles, instructions and misses per phase and thread to stderr (Linux)\n"
+           << "  --huge-pages      store results of each thread in one region on huge pages\n";
+        return;
+    }
+
+    // "1129" 形式の牌の並びを、待ち牌の集合(1..9をbit 0..8に置く)と、
+    // 牌の数をSizeOfBitsPerTileビットごとに並べたビット列にする。解釈できなければfalseを返す。
+    bool ParseTiles(const std::string& str, TileMap& tileSet, TileMap& tileMap) {
+        tileSet = 0;
+        tileMap = 0;
+        for(auto c : str) {
+            if ((c < '1') || (c > '9')) {
+                return false;
+            }
+
+            const SizeType tile = c - '0';
+            const auto shift = (tile - TileMin) * SizeOfBitsPerTile;
+            const TileMap fieldMask = static_cast<TileMap>(0x1f) << shift;
+            tileSet |= static_cast<TileMap>(1) << (tile - TileMin);
+            // 同じ牌は下位から詰めて、牌の数を1の並びで表す
+            tileMap |= (((tileMap >> shift) + 1) << shift) & fieldMask;
+            if (tileMap & (static_cast<TileMap>(1) << (shift + SizeOfOneTile))) {
+                return false;
+            }
+        }
+
+        return !str.empty();
+    }
+
+    // 手牌の順番か13牌の手牌を、手牌の順番(0..SizeOfAllHands)にする。解釈できなければfalseを返す。
+    bool ParseRank(const std::string& str, SizeType& rank) {
+        HandNumber number = 0;
+        if (ParseHand(str, number)) {
+            rank = GetHandRank(number);
+            return true;
+        }
+
+        char* end = nullptr;
+        const auto value = std::strtoull(str.c_str(), &end, 10);
+        if (str.empty() || (*end != '\0') || (value > SizeOfAllHands)) {
+            return false;
+        }
+
+        rank = value;
+        return true;
+    }
+
+    // "i/N" 形式の分け方を解釈する。解釈できなければfalseを返す。
+    bool ParseShard(const std::string& str, SizeType& index, SizeType& size) {
+        char* end = nullptr;
+        index = std::strtoull(str.c_str(), &end, 10);
+        if ((end == str.c_str()) || (*end != '/')) {
+            return false;
+        }
+
+        const char* sizeStr = end + 1;
+        size = std::strtoull(sizeStr, &end, 10);
+        return (end != sizeStr) && (*end == '\0') && (index < size);
+    }
+
+    // 動作の種類。起動時の引数で一つ選ぶ。
+    enum class Mode {
+        Solve,      // 既定の出力
+        Verify,     // --verify
+        Server,     // --server
+        EmitTable,  // --emit-table
+        Index,      // --index, --index-bench
+        Stats,      // --stats
+        WaitsOnly,  // --waits-only
+        Cache,      // --cache
+        Query,      // --query
+        Pipeline,   // --pipeline
+        Client,     // --client
+    };
+
+    // 複数の動作を指定したときは、この順に先のものを選ぶ
+    Mode GetMode(const Options& options) {
+        if (options.verify) {
+            return Mode::Verify;
+        } else if (!options.serverPath.empty()) {
+            return Mode::Server;
+        } else if (!options.tablePath.empty()) {
+            return Mode::EmitTable;
+        } else if (!options.indexQuery.empty() || options.indexBench) {
+            return Mode::Index;
+        } else if (options.stats) {
+            return Mode::Stats;
+        } else if (options.waitsOnly) {
+            return Mode::WaitsOnly;
+        } else if (!options.cachePath.empty()) {
+            return Mode::Cache;
+        } else if (options.query) {
+            return Mode::Query;
+        } else if (options.pipeline) {
+            return Mode::Pipeline;
+        } else if (!options.clientPath.empty()) {
+            return Mode::Client;
+        }
+        return Mode::Solve;
+    }
+
+    const char* GetModeName(Mode mode) {
+        static const char* const nameSet[] = {"the default output", "--verify", "--server", "--emit-table", "--index",
+                                              "--stats", "--waits-only", "--cache", "--query", "--pipeline", "--client"};
+        return nameSet[static_cast<SizeType>(mode)];
+    }
+
+    // 起動時の引数を解釈する。解釈できなければfalseを返す。
+    bool ParseOptions(int argc, char* argv[], Options& options) {
+        for(int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg.find("-N") == 0) {
+                options.sizeOfThreads = GetSizeOfThreads(argv[i]);
+                options.sizeOfThreadsSpecified = (arg.size() > 2);
+            } else if (arg == "-v") {
+                options.verbose = true;
+                EnableAllocationCount();
+            } else if (arg == "--verify") {
+                options.verify = true;
+            } else if (arg.find("--cpus=") == 0) {
+                if (!ParseCpuList(arg.substr(7), options.cpuSet)) {
+                    std::cerr << "Invalid CPU list: " << arg << "\n";
+                    return false;
+                }
+                options.placed = true;
+            } else if (arg == "--physical-cores") {
+                options.physicalCores = true;
+                options.placed = true;
+            } else if (arg == "--numa-local") {
+                options.numaLocal = true;
+                options.placed = true;
+            } else if (arg.find("--server=") == 0) {
+                options.serverPath = arg.substr(9);
+            } else if (arg.find("--client=") == 0) {
+                options.clientPath = arg.substr(9);
+            } else if (arg.find("--requests=") == 0) {
+                options.sizeOfRequests = std::strtoull(arg.c_str() + 11, nullptr, 10);
+            } else if (arg == "--shutdown") {
+                options.shutdownServer = true;
+            } else if (arg.find("--emit-table=") == 0) {
+                options.tablePath = arg.substr(13);
+            } else if (arg == "--query") {
+                options.query = true;
+            } else if (arg.find("--cache=") == 0) {
+                options.cachePath = arg.substr(8);
+            } else if (arg == "--waits-only") {
+                options.waitsOnly = true;
+            } else if (arg == "--stats") {
+                options.stats = true;
+            } else if ((arg.find("--wait=") == 0) || (arg.find("--with=") == 0)) {
+                TileMap tileSet = 0;
+                TileMap tileMap = 0;
+                if (!ParseTiles(arg.substr(7), tileSet, tileMap)) {
+                    std::cerr << "Invalid tiles: " << arg << "\n";
+                    return false;
+                }
+                if (arg.find("--wait=") == 0) {
+                    options.filter.waitMask = tileSet;
+                } else {
+                    options.filter.requiredTiles = tileMap;
+                }
+                options.filtered = true;
+            } else if (arg.find("--min-forms=") == 0) {
+                options.filter.minSizeOfForms = std::strtoull(arg.c_str() + 12, nullptr, 10);
+                options.filtered = true;
+                options.formsFiltered = true;
+            } else if (arg.find("--max-forms=") == 0) {
+                options.filter.maxSizeOfForms = std::strtoull(arg.c_str() + 12, nullptr, 10);
+                options.filtered = true;
+                options.formsFiltered = true;
+            } else if (arg == "--tenpai") {
+                options.filter.tenpaiOnly = true;
+                options.filtered = true;
+            } else if (arg.find("--index=") == 0) {
+                options.indexQuery = arg.substr(8);
+            } else if (arg == "--index-bench") {
+                options.indexBench = true;
+            } else if (arg == "--pipeline") {
+                options.pipeline = true;
+            } else if (arg.find("--queue-depth=") == 0) {
+                options.pipelineConfig.queueDepth = std::max(std::strtoull(arg.c_str() + 14, nullptr, 10), 1ull);
+            } else if (arg.find("--batch-size=") == 0) {
+                options.pipelineConfig.batchSize = std::strtoull(arg.c_str() + 13, nullptr, 10);
+                if ((options.pipelineConfig.batchSize == 0) ||
+                    (options.pipelineConfig.batchSize > MaxPipelineBatchSize)) {
+                    std::cerr << "Invalid batch size: " << arg << "\n";
+                    return false;
+                }
+            } else if ((arg.find("--from=") == 0) || (arg.find("--to=") == 0)) {
+                const bool from = (arg.find("--from=") == 0);
+                SizeType rank = 0;
+                if (!ParseRank(arg.substr(from ? 7 : 5), rank)) {
+                    std::cerr << "Invalid rank or hand: " << arg << "\n";
+                    return false;
+                }
+                (from ? options.range.first : options.range.last) = rank;
+                options.ranged = true;
+            } else if (arg == "--latency") {
+                options.latency = true;
+                EnableSolveLatency(true);
+            } else if (arg == "--huge-pages") {
+                options.hugePages = true;
+            } else if (arg == "--perf") {
+                // 数えられなくても、数えずに解く
+                std::string message;
+                options.perf = EnablePerfCounters(message);
+                if (!message.empty()) {
+                    std::cerr << (options.perf ? "perf counters " : "perf counters disabled: ") << message << "\n";
+                }
+            } else if (arg.find("--shard=") == 0) {
+                if (!ParseShard(arg.substr(8), options.shardIndex, options.sizeOfShards)) {
+                    std::cerr << "Invalid shard: " << arg << "\n";
+                    return false;
+                }
+                options.ranged = true;
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                printUsage(std::cerr);
+                return false;
+            }
+        }
+
+        // 書き出す手牌の条件を使えない動作では、条件を無視せずに断る
+        const auto mode = GetMode(options);
+        if (options.filtered) {
+            const bool accepted = (mode == Mode::Solve) || (mode == Mode::Pipeline) || (mode == Mode::Cache) ||
+                ((mode == Mode::WaitsOnly) && !options.formsFiltered);
+            if (!accepted) {
+                std::cerr << "Hand filters cannot be used with " << GetModeName(mode)
+                          << ((mode == Mode::WaitsOnly) ? " (it does not find wait forms)" : "") << "\n";
+                return false;
+            }
+        }
+
+        // スレッドを配置するのは既定の出力だけ。他の動作のスレッドは配置しないので、指定を断る。
+        if (options.placed && (mode != Mode::Solve)) {
+            std::cerr << "--cpus, --physical-cores and --numa-local cannot be used with " << GetModeName(mode) << "\n";
+            return false;
+        }
+
+        // 範囲を指定できるのは既定の出力だけ。他の動作で全手牌や#行のない出力を書かないように断る。
+        if (options.ranged && (mode != Mode::Solve)) {
+            std::cerr << "--from, --to and --shard cannot be used with " << GetModeName(mode) << "\n";
+            return false;
+        }
+
+        if (options.range.first > options.range.last) {
+            std::cerr << "Invalid range: " << options.range.first << " to " << options.range.last << "\n";
+            return false;
+        }
+
+        // 範囲をsizeOfShards等分する
+        const auto range = options.range;
+        options.range.first = range.first + range.size() * options.shardIndex / options.sizeOfShards;
+        options.range.last = range.first + range.size() * (options.shardIndex + 1) / options.sizeOfShards;
+
+        // 物理コアごとに一つの論理CPUを選び、スレッド数を指定しなければ物理コア数にする
+        if (options.physicalCores) {
+            options.cpuSet = GetPhysicalCoreCpus(options.cpuSet);
+            if ((options.sizeOfThreads > 1) && !options.sizeOfThreadsSpecified && !options.cpuSet.empty()) {
+                options.sizeOfThreads = static_cast<SizeOfThreads>(options.cpuSet.size());
+            }
+        }
+
+        // 固定していないスレッドは他のNUMAノードに移りうるので、そのノードのメモリに置いても意味がない
+        if (options.numaLocal && options.cpuSet.empty()) {
+            std::cerr << "--numa-local needs threads pinned by --cpus or --physical-cores\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    // 全手牌の待ちの表をファイルに書き出す
+    bool EmitTable(const Options& options) {
+        const auto table = BuildWaitTable(options.sizeOfThreads);
+        std::ofstream os(options.tablePath, std::ios::binary);
+        os.write(table.data(), static_cast<std::streamsize>(table.size()));
+        if (!os) {
+            std::cerr << "Cannot write " << options.tablePath << "\n";
+            return false;
+        }
+
+        if (options.verbose) {
+            std::cerr << "Wrote " << table.size() << " bytes to " << options.tablePath << "\n";
+        }
+        return true;
+    }
+
+    // 手牌の番号がfirst以上last未満の手牌のうち、filterを満たす手牌について、待ち牌を一行ずつstrに書く
+    // 待ち形は求めないので、filterの待ち形の数の条件は調べない。書いた手牌の数を返す。
+    SizeType findWaitMasks(SizeType first, SizeType last, const HandFilter& filter, std::string& str) {
+        SizeType sizeOfHands = 0;
+        for(SizeType rank = first; rank < last; ++rank) {
+            const auto number = GetHandNumber(rank);
+            if (!filter.AcceptsTiles(HandToTileMap(number))) {
+                continue;
+            }
+
+            const auto waitMask = FindWaitMask(number);
+            if (!filter.AcceptsWaitMask(waitMask)) {
+                continue;
+            }
+
+            ++sizeOfHands;
+            str += HandToString(number);
+            str += ':';
+            if (waitMask == 0) {
+                str += "(none)";
+            }
+            for(SizeType tile = TileMin; tile <= TileMax; ++tile) {
+                if (waitMask & (static_cast<TileMap>(1) << (tile - TileMin))) {
+                    str += static_cast<char>('0' + tile);
+                }
+            }
+            str += '\n';
+        }
+        return sizeOfHands;
+    }
+
+    // すべての手牌について、分解を求めずに待ち牌だけを書き出す
+    // 各スレッドは連続した番号の手牌を受け持つので、スレッドの順に書き出すと番号順になる
+    void SolveWaitsOnly(const Options& options, std::ostream& os) {
+        const SizeType sizeOfThreads = std::max(options.sizeOfThreads, static_cast<SizeOfThreads>(1));
+        std::vector<std::string> resultSet(sizeOfThreads);
+        std::vector<SizeType> sizeOfHandsSet(sizeOfThreads, 0);
+        std::vector<THREAD_FUTURE<void>> futureSet;
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
+            const SizeType first = SizeOfAllHands * index / sizeOfThreads;
+            const SizeType last = SizeOfAllHands * (index + 1) / sizeOfThreads;
+            futureSet.push_back(
+                THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                             [&options, &resultSet, &sizeOfHandsSet, index, first, last](void) -> void
+                             { sizeOfHandsSet.at(index) = findWaitMasks(first, last, options.filter,
+                                                                        resultSet.at(index)); }));
+        }
+
+        for(auto& f : futureSet) {
+            f.get();
+        }
+
+        SizeType sizeOfHands = 0;
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
+            os << resultSet.at(index);
+            sizeOfHands += sizeOfHandsSet.at(index);
+        }
+
+        if (options.verbose) {
+            const auto pruneCount = GetPruneCount();
+            std::cerr << "threads: " << sizeOfThreads << "\n"
+                      << "hands: " << sizeOfHands << "\n"
+                      << "pairs: " << pruneCount.tried << " tried, " << pruneCount.pruned
+                      << " pruned before splitting\n";
+        }
+
+        return;
+    }
+
+    // 読み取り専用でmmapしたファイル
+    // mmapできない環境ではメモリに読み込む
+    class MappedFile {
+    public:
+        MappedFile(void) : data_(nullptr), size_(0) {
+            return;
+        }
+
+        ~MappedFile(void) {
+#ifndef _WIN32
+            if (data_ != nullptr) {
+                ::munmap(data_, size_);
+            }
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // ファイルを開けなければfalseを返す
+        bool Open(const std::string& path) {
+#ifndef _WIN32
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat st;
+            if ((::fstat(fd, &st) == 0) && (st.st_size > 0)) {
+                size_ = static_cast<SizeType>(st.st_size);
+                void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+                data_ = (p == MAP_FAILED) ? nullptr : p;
+            }
+            ::close(fd);
+            return (data_ != nullptr);
+#else
+            std::ifstream is(path, std::ios::binary);
+            buffer_.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+            return is.good() || is.eof();
+#endif
+        }
+
+        const void* GetData(void) const {
+            return data_;
+        }
+
+        SizeType GetSize(void) const {
+            return size_;
+        }
+
+    private:
+        void* data_;
+        SizeType size_;
+#ifdef _WIN32
+        std::vector<char> buffer_;
+#endif
+    };
+
+    // 表を一時ファイルに書いてから置き換えて、読んでいる他のプロセスに書きかけの表を見せない
+    // 一時ファイルの名前はプロセスごとに変えるので、同時に書く他のプロセスと混ざらない。
+    // 置き換える前にディスクに書き出すので、途中で電源が落ちても空や書きかけの表は残らない。
+    bool writeTableFile(const std::string& path, const std::vector<char>& table) {
+#ifndef _WIN32
+        std::string tempPath = path + ".XXXXXX";
+        const int fd = ::mkstemp(&tempPath[0]);
+        if (fd < 0) {
+            return false;
+        }
+
+        const char* data = table.data();
+        SizeType rest = table.size();
+        bool written = true;
+        while(written && (rest > 0)) {
+            const auto size = ::write(fd, data, rest);
+            written = (size > 0);
+            if (written) {
+                data += size;
+                rest -= static_cast<SizeType>(size);
+            }
+        }
+        written = written && (::fsync(fd) == 0);
+        written = (::close(fd) == 0) && written;
+        // mkstempは所有者だけが読める権限で作るので、通常のファイルと同じ権限にする
+        if (written) {
+            const auto mask = ::umask(0);
+            ::umask(mask);
+            written = (::chmod(tempPath.c_str(), 0666 & ~mask) == 0);
+        }
+#else
+        const std::string tempPath = path + "." + std::to_string(::_getpid()) + ".tmp";
+        bool written = false;
+        {
+            std::ofstream os(tempPath, std::ios::binary | std::ios::trunc);
+            os.write(table.data(), static_cast<std::streamsize>(table.size()));
+            os.flush();
+            written = static_cast<bool>(os);
+        }
+#endif
+        written = written && (std::rename(tempPath.c_str(), path.c_str()) == 0);
+        if (!written) {
+            std::remove(tempPath.c_str());
+        }
+        return written;
+    }
+
+    // 表から、filterを満たす手牌の待ちを順に書き出す
+    void printWaitTable(const WaitTableView& view, const HandFilter& filter, std::ostream& os) {
+        std::string result;
+        for(SizeType rank = 0; rank < SizeOfAllHands; ++rank) {
+            if (filter.AcceptsTiles(HandToTileMap(GetHandNumber(rank))) &&
+                filter.AcceptsWaitMask(view.GetWaitMask(rank)) && filter.AcceptsForms(view.GetSizeOfKeys(rank))) {
+                view.Print(rank, result);
+            }
+        }
+        os << result;
+        return;
+    }
+
+    // ファイルの表をmmapして書き出す。ファイルがないか、版やチェックサムが合わなければ、
+    // 解いた結果をファイルに書いてから書き出す。
+    bool SolveWithCache(const Options& options, std::ostream& os) {
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+
+        MappedFile file;
+        WaitTableView view;
+        std::vector<char> table;
+        const bool hit = file.Open(options.cachePath) && view.Attach(file.GetData(), file.GetSize(), true);
+        bool written = true;
+
+        if (!hit) {
+            table = BuildWaitTable(options.sizeOfThreads);
+            view.Attach(table.data(), table.size(), false);
+            written = writeTableFile(options.cachePath, table);
+            if (!written) {
+                std::cerr << "Cannot write " << options.cachePath << "\n";
+            }
+        }
+
+        const auto loaded = Clock::now();
+        printWaitTable(view, options.filter, os);
+        os.flush();
+        const auto printed = Clock::now();
+
+        if (options.verbose) {
+            const auto toMilliseconds = [](Clock::duration d) -> double
+                { return std::chrono::duration<double, std::milli>(d).count(); };
+            std::cerr << "cache: " << (hit ? "warm (mapped " : "cold (solved and wrote ") << options.cachePath << ")\n"
+                      << "load: " << toMilliseconds(loaded - start) << " ms\n"
+                      << "print: " << toMilliseconds(printed - loaded) << " ms\n";
+        }
+
+        return written;
+    }
+
+    // 標準入力の手牌の待ちを、埋め込んだ表から引いて書き出す
+    // 表が埋め込まれていなければ、手牌ごとに解く
+    void AnswerQueries(const Options& options, std::istream& is, std::ostream& os) {
+        WaitTableView view;
+        const bool embedded = GetEmbeddedWaitTable(view);
+        if (options.verbose) {
+            std::cerr << "Wait table : " << (embedded ? "embedded" : "not embedded, solving each hand") << "\n";
+        }
+
+        std::string line;
+        std::string result;
+        WaitResult waitResult;
+        while(std::getline(is, line)) {
+            if (!line.empty() && (line.back() == '\r')) {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+
+            result.clear();
+            HandNumber number = 0;
+            if (!ParseHand(line, number)) {
+                result = "(invalid input)\n";
+            } else if (embedded) {
+                view.Print(GetHandRank(number), result);
+            } else {
+                SolveHand(number, waitResult);
+                result = HandToString(number) + ":\n";
+                PrintWaitKeys(waitResult.keys.begin(), waitResult.keys.size(), result);
+            }
+            os << result;
+        }
+
+        return;
+    }
+
+    // 索引を引く時間を測る式
+    const char* const IndexBenchQuerySet[] = {
+        "5&8", "1|9", "sides|edge", "single-pair", "[1]&[4]", "tenpai-1-2-3-4-5-6-7-8"
+    };
+
+    // 索引を引いて、式を満たす手牌を書き出す
+    // --index-benchなら、索引を作る時間と、式ごとに繰り返し引いた時間を書き出す
+    bool QueryIndex(const Options& options, std::ostream& os) {
+        using Clock = std::chrono::steady_clock;
+        const auto buildStart = Clock::now();
+
+        WaitTableView view;
+        std::vector<char> table;
+        const bool embedded = GetEmbeddedWaitTable(view);
+        if (!embedded) {
+            table = BuildWaitTable(options.sizeOfThreads);
+            view.Attach(table.data(), table.size(), false);
+        }
+
+        // 手牌の集合は一つ12KB弱なので、スタックに置かない
+        std::unique_ptr<HandIndex> index(new HandIndex(view));
+        std::unique_ptr<HandSet> result(new HandSet());
+        const auto buildTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+
+        if (options.indexBench) {
+            constexpr SizeType SizeOfRepeats = 10000;
+            os << "build: " << buildTime << " msec (" << (embedded ? "embedded table" : "solved") << ")\n";
+            for(auto expr : IndexBenchQuerySet) {
+                const auto start = Clock::now();
+                for(SizeType i = 0; i < SizeOfRepeats; ++i) {
+                    index->Query(expr, *result);
+                }
+                const auto time = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                os << expr << " : " << result->Count() << " hands, "
+                   << (time / SizeOfRepeats) << " usec per query\n";
+            }
+            return true;
+        }
+
+        const auto start = Clock::now();
+        if (!index->Query(options.indexQuery, *result)) {
+            std::cerr << "Invalid expression: " << options.indexQuery << "\n";
+            return false;
+        }
+        const auto queryTime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        std::string str;
+        for(SizeType rank = 0; rank < SizeOfAllHands; ++rank) {
+            if (result->Contains(rank)) {
+                view.Print(rank, str);
+            }
+        }
+        os << str;
+
+        if (options.verbose) {
+            std::cerr << "index: " << buildTime << " msec to build (" << (embedded ? "embedded table" : "solved")
+                      << "), " << queryTime << " usec to query\n"
+                      << "hands: " << result->Count() << "\n";
+        }
+
+        return true;
+    }
+
+    // 選んだ動作を実行して、終了コードを返す
+    int RunMode(Options& options) {
+        switch(GetMode(options)) {
+        case Mode::Verify:
+            return VerifyAll(options.sizeOfThreads, std::cout) ? 0 : 1;
+        case Mode::Server:
+            return RunServer(options.serverPath, options.sizeOfThreads, std::cerr) ? 0 : 1;
+        case Mode::EmitTable:
+            return EmitTable(options) ? 0 : 1;
+        case Mode::Index:
+            return QueryIndex(options, std::cout) ? 0 : 1;
+        case Mode::Stats:
+            CollectStats(options.sizeOfThreads, std::cout);
+            return 0;
+        case Mode::WaitsOnly:
+            SolveWaitsOnly(options, std::cout);
+            return 0;
+        case Mode::Cache:
+            return SolveWithCache(options, std::cout) ? 0 : 1;
+        case Mode::Query:
+            AnswerQueries(options, std::cin, std::cout);
+            return 0;
+        case Mode::Pipeline:
+            options.pipelineConfig.sizeOfSolvers = options.sizeOfThreads;
+            SolvePipelined(options.pipelineConfig, options.filter, std::cout, options.verbose ? &std::cerr : nullptr);
+            return 0;
+        case Mode::Client:
+            return RunClient(options.clientPath, options.sizeOfThreads, options.sizeOfRequests,
+                             options.shutdownServer, std::cout) ? 0 : 1;
+        case Mode::Solve:
+        default:
+            break;
+        }
+
+        SolveAll(options, std::cout);
+        return 0;
+    }
 }
 
 int main(int argc, char* argv[]) {
-    SizeOfThreads sizeOfThreads = (argc > 1) ? GetSizeOfThreads(argv[1]) : 1;
-    SolveAll(sizeOfThreads, std::cout);
-    return 0;
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    const auto exitCode = RunMode(options);
+
+    // 表を作る、問い合わせる、などの一手牌ずつ解く動作も含めて、解いた時間を書き出す
+    if (options.latency) {
+        SolveLatency latency;
+        GetSolveLatency(latency);
+        if (latency.all.GetCount() > 0) {
+            printSolveLatency(latency, std::cerr);
+        }
+    }
+    return exitCode;
 }
 
 /*
@@ -0,0 +1,305 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * perf_event_openで、スレッドごとに性能カウンタを区間に分けて数える
+ * カウンタは一つのグループにして、区間を切り替えるたびにまとめて一回読む。
+ * ユーザ空間だけを数えるので、perf_event_paranoidが2でも数えられる。
+ * ハードウェアのカウンタがない環境(仮想マシンなど)では、数えられる種類だけを数える。
+ * Linux以外では何も数えない。
+ * 手牌ごとに解く時間の全スレッドの合計もここに置く。
+ * countTilesBitsSolver.cppはIntel形式のアセンブリで書くので、スレッドのヘッダを読み込めない。
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace TileSetSolver;
+
+namespace {
+    // 一回読むのに掛かる分を、続けて読んだ差の最小値で見積もる回数
+    constexpr SizeType SizeOfCalibrations = 16;
+
+    std::atomic<bool> perfCountersEnabled {false};
+    THREAD_MUTEX perfCountMutex;
+    std::vector<PerfThreadCount> perfCountSet;
+
+    // 手牌ごとに解く時間の全スレッドの合計
+    THREAD_MUTEX solveLatencyMutex;
+    SolveLatency totalSolveLatency;
+
+#ifdef __linux__
+    // 種類ごとのperf_event_attrの値
+    struct PerfEventConfig {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    const std::array<PerfEventConfig, SizeOfPerfEvents> PerfEventConfigSet {{
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+    }};
+
+    // 呼び出したスレッドのカウンタを開く。開けなければ-1を返してerrnoを設定する。
+    int openPerfEvent(const PerfEventConfig& eventConfig, int groupFd) {
+        struct perf_event_attr attr;
+        ::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = eventConfig.type;
+        attr.config = eventConfig.config;
+        attr.disabled = (groupFd < 0) ? 1 : 0;  // 先頭を有効にすると、グループ全体が数え始める
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+#endif
+
+    uint64_t subtractOrZero(uint64_t lhs, uint64_t rhs) {
+        return (lhs > rhs) ? (lhs - rhs) : 0;
+    }
+}
+
+namespace TileSetSolver {
+    PerfCollector::PerfCollector(const std::string& name, PerfPhase phase) : leader_(-1), phase_(phase) {
+        fdSet_.fill(-1);
+        last_.fill(0);
+        overhead_.fill(0);
+        count_.name = name;
+        count_.available.fill(false);
+        for(auto& values : count_.values) {
+            values.fill(0);
+        }
+        count_.switches = 0;
+        count_.multiplexed = false;
+
+#ifdef __linux__
+        for(SizeType event = 0; event < SizeOfPerfEvents; ++event) {
+            const auto fd = openPerfEvent(PerfEventConfigSet[event], leader_);
+            if (fd < 0) {
+                continue;
+            }
+
+            fdSet_[event] = fd;
+            count_.available[event] = true;
+            if (leader_ < 0) {
+                leader_ = fd;
+            }
+        }
+
+        if (leader_ < 0) {
+            return;
+        }
+
+        ::ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+        // 区間には、前後の切り替えで読む処理が一回分ずつ含まれるので、その分を見積もっておく
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+        overhead_.fill(UINT64_MAX);
+        read(last_, enabled, running);
+        for(SizeType i = 0; i < SizeOfCalibrations; ++i) {
+            PerfValues values;
+            read(values, enabled, running);
+            for(SizeType event = 0; event < SizeOfPerfEvents; ++event) {
+                overhead_[event] = std::min(overhead_[event], subtractOrZero(values[event], last_[event]));
+            }
+            last_ = values;
+        }
+#endif
+        return;
+    }
+
+    PerfCollector::~PerfCollector(void) {
+        if (leader_ >= 0) {
+            accumulate();
+            THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(perfCountMutex);
+            perfCountSet.push_back(count_);
+        }
+
+#ifdef __linux__
+        for(auto fd : fdSet_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+        return;
+    }
+
+    bool PerfCollector::IsOpen(void) const {
+        return (leader_ >= 0);
+    }
+
+    void PerfCollector::Switch(PerfPhase phase) {
+        if (leader_ < 0) {
+            return;
+        }
+
+        accumulate();
+        phase_ = phase;
+        ++count_.switches;
+        return;
+    }
+
+    // 直前に読んでから増えた分を、今の区間に加える
+    void PerfCollector::accumulate(void) {
+        PerfValues values;
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+        if (!read(values, enabled, running)) {
+            return;
+        }
+
+        auto& phaseValues = count_.values[phase_];
+        for(SizeType event = 0; event < SizeOfPerfEvents; ++event) {
+            phaseValues[event] += subtractOrZero(subtractOrZero(values[event], last_[event]), overhead_[event]);
+        }
+        last_ = values;
+        count_.multiplexed = (running < enabled);
+        return;
+    }
+
+    // グループのカウンタをまとめて読んで、種類ごとの添え字に並べ替える
+    bool PerfCollector::read(PerfValues& values, uint64_t& enabled, uint64_t& running) const {
+        values.fill(0);
+#ifdef __linux__
+        // 数、有効だった時間、数えていた時間、開いた順の値
+        std::array<uint64_t, 3 + SizeOfPerfEvents> buffer;
+        const auto size = ::read(leader_, buffer.data(), sizeof(buffer));
+        if (size < static_cast<decltype(size)>(sizeof(uint64_t) * 3)) {
+            return false;
+        }
+
+        enabled = buffer[1];
+        running = buffer[2];
+        SizeType slot = 3;
+        for(SizeType event = 0; (event < SizeOfPerfEvents) && (slot < (3 + buffer[0])); ++event) {
+            if (fdSet_[event] >= 0) {
+                values[event] = buffer[slot];
+                ++slot;
+            }
+        }
+        return true;
+#else
+        enabled = 0;
+        running = 0;
+        return false;
+#endif
+    }
+
+    bool EnablePerfCounters(std::string& message) {
+        message.clear();
+#ifdef __linux__
+        // 種類ごとに開いてみて、開けなかった種類を理由と一緒に挙げる
+        SizeType sizeOfEvents = 0;
+        for(SizeType event = 0; event < SizeOfPerfEvents; ++event) {
+            const auto fd = openPerfEvent(PerfEventConfigSet[event], -1);
+            if (fd >= 0) {
+                ::close(fd);
+                ++sizeOfEvents;
+                continue;
+            }
+            message += std::string(message.empty() ? "" : ", ") + GetPerfEventName(static_cast<PerfEvent>(event))
+                + " (" + ::strerror(errno) + ")";
+        }
+
+        if (sizeOfEvents == 0) {
+            message = "perf_event_open failed: " + message;
+            return false;
+        }
+        if (!message.empty()) {
+            message = "not available: " + message;
+        }
+
+        perfCountersEnabled.store(true);
+        return true;
+#else
+        message = "perf_event_open is available only on Linux";
+        return false;
+#endif
+    }
+
+    std::unique_ptr<PerfCollector> StartPerfCounters(const char* name, PerfPhase phase) {
+        std::unique_ptr<PerfCollector> collector;
+        if (perfCountersEnabled.load()) {
+            collector.reset(new PerfCollector(name, phase));
+            if (!collector->IsOpen()) {
+                collector.reset();
+            }
+        }
+        return collector;
+    }
+
+    std::unique_ptr<PerfCollector> StartPerfCounters(const char* name, SizeType index, PerfPhase phase) {
+        std::unique_ptr<PerfCollector> collector;
+        if (perfCountersEnabled.load()) {
+            collector.reset(new PerfCollector(std::string(name) + " " + std::to_string(index), phase));
+            if (!collector->IsOpen()) {
+                collector.reset();
+            }
+        }
+        return collector;
+    }
+
+    std::vector<PerfThreadCount> GetPerfCounters(void) {
+        THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(perfCountMutex);
+        return perfCountSet;
+    }
+
+    void MergeSolveLatency(const SolveLatency& latency) {
+        THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(solveLatencyMutex);
+        totalSolveLatency.Merge(latency);
+        return;
+    }
+
+    void RecordSolveLatency(uint64_t nsec, SizeType sizeOfWaits, uint64_t branches) {
+        THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(solveLatencyMutex);
+        totalSolveLatency.Record(nsec, sizeOfWaits, branches);
+        return;
+    }
+
+    void GetSolveLatency(SolveLatency& latency) {
+        THREAD_UNIQUE_LOCK<THREAD_MUTEX> lock(solveLatencyMutex);
+        latency.Merge(totalSolveLatency);
+        return;
+    }
+
+    const char* GetPerfPhaseName(PerfPhase phase) {
+        static const char* const nameSet[] = {"enumerate", "decompose", "filter", "print", "output"};
+        return (phase < SizeOfPerfPhases) ? nameSet[phase] : "";
+    }
+
+    const char* GetPerfEventName(PerfEvent event) {
+        static const char* const nameSet[] = {"task-clock", "cycles", "instructions", "branch-misses", "L1-dcache-load-misses"};
+        return (event < SizeOfPerfEvents) ? nameSet[event] : "";
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,385 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * 全手牌を、手牌を作る段、解く段、書き出す段に分けて並行して解く
+ * 手牌を作る段 -> (MPMCリングバッファ) -> 解く段(複数) -> (解く段ごとのSPSCリングバッファ) -> 書き出す段
+ * 手牌はbatchSize個ずつ通し番号をつけて渡す。解く段は通し番号の順に取るので、
+ * 各SPSCリングバッファの中身も通し番号順に並び、書き出す段は先頭だけを見れば順番通りに書き出せる。
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // 2のべき乗に切り上げる
+    SizeType roundUpToPowerOfTwo(SizeType size) {
+        SizeType power = 1;
+        while(power < size) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    // 複数のスレッドが入れて複数のスレッドが取り出す、長さ固定のリングバッファ
+    // 要素の中身は、枠を確保してから直接読み書きして、終わったら次の段に渡す
+    template <typename T>
+    class MpmcRing {
+    public:
+        explicit MpmcRing(SizeType capacity) :
+            cellSet_(roundUpToPowerOfTwo(capacity)), mask_(cellSet_.size() - 1), pushPosition_(0), popPosition_(0) {
+            for(SizeType i = 0; i < cellSet_.size(); ++i) {
+                cellSet_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        // 入れる枠を確保する。満杯ならnullptrを返す。
+        T* BeginPush(SizeType& position) {
+            position = pushPosition_.load(std::memory_order_relaxed);
+            for(;;) {
+                auto& cell = cellSet_[position & mask_];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                if (sequence == position) {
+                    if (pushPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        return &cell.data;
+                    }
+                } else if (sequence < position) {
+                    return nullptr;
+                } else {
+                    position = pushPosition_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // 入れた枠を取り出せるようにする
+        void EndPush(SizeType position) {
+            cellSet_[position & mask_].sequence.store(position + 1, std::memory_order_release);
+            return;
+        }
+
+        // 取り出す枠を確保する。空ならnullptrを返す。
+        T* BeginPop(SizeType& position) {
+            position = popPosition_.load(std::memory_order_relaxed);
+            for(;;) {
+                auto& cell = cellSet_[position & mask_];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                if (sequence == (position + 1)) {
+                    if (popPosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        return &cell.data;
+                    }
+                } else if (sequence < (position + 1)) {
+                    return nullptr;
+                } else {
+                    position = popPosition_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // 取り出した枠を、次に入れられるようにする
+        void EndPop(SizeType position) {
+            cellSet_[position & mask_].sequence.store(position + mask_ + 1, std::memory_order_release);
+            return;
+        }
+
+    private:
+        struct Cell {
+            std::atomic<SizeType> sequence;
+            T data;
+        };
+
+        std::vector<Cell> cellSet_;
+        const SizeType mask_;
+        // 入れる側と取り出す側が同じキャッシュラインを取り合わないようにする
+        std::atomic<SizeType> pushPosition_;
+        char padding_[64];
+        std::atomic<SizeType> popPosition_;
+    };
+
+    // 一つのスレッドが入れて一つのスレッドが取り出す、長さ固定のリングバッファ
+    template <typename T>
+    class SpscRing {
+    public:
+        explicit SpscRing(SizeType capacity) :
+            slotSet_(roundUpToPowerOfTwo(capacity)), mask_(slotSet_.size() - 1), head_(0), tail_(0) {
+            return;
+        }
+
+        // 入れる枠を返す。満杯ならnullptrを返す。
+        T* BeginPush(void) {
+            const auto head = head_.load(std::memory_order_relaxed);
+            if ((head - tail_.load(std::memory_order_acquire)) > mask_) {
+                return nullptr;
+            }
+            return &slotSet_[head & mask_];
+        }
+
+        void EndPush(void) {
+            head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return;
+        }
+
+        // 先頭の枠を返す。空ならnullptrを返す。
+        T* Peek(void) {
+            const auto tail = tail_.load(std::memory_order_relaxed);
+            if (tail == head_.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &slotSet_[tail & mask_];
+        }
+
+        void Pop(void) {
+            tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return;
+        }
+
+    private:
+        std::vector<T> slotSet_;
+        const SizeType mask_;
+        std::atomic<SizeType> head_;
+        char padding_[64];
+        std::atomic<SizeType> tail_;
+    };
+
+    // 手牌を作る段から解く段に渡す手牌
+    struct HandBatch {
+        SizeType sequence;  // 通し番号。sizeが0なら終わりの印。
+        SizeType size;
+        std::array<HandNumber, MaxPipelineBatchSize> handSet;
+    };
+
+    // 解く段から書き出す段に渡す文字列
+    struct TextBatch {
+        SizeType sequence;
+        SizeType sizeOfHands;  // 書き出す手牌の数
+        std::string text;
+    };
+
+    // 段ごとの時間
+    struct StageTime {
+        double total {0.0};  // 段が動いていた時間
+        double wait {0.0};   // 前後の段を待っていた時間
+        SizeType batches {0};
+
+        void Print(const char* name, std::ostream& os) const {
+            const auto busy = std::max(total - wait, 0.0);
+            os << name << " : " << batches << " batches, busy " << busy << " msec / "
+               << total << " msec (" << ((total > 0.0) ? (busy * 100.0 / total) : 0.0) << "%)\n";
+            return;
+        }
+    };
+
+    double getMsec(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // pushOrPopがnullptrでなくなるまで譲る。待った時間をwaitに足す。
+    template <typename F>
+    auto waitFor(F pushOrPop, double& wait) -> decltype(pushOrPop()) {
+        auto p = pushOrPop();
+        if (p) {
+            return p;
+        }
+
+        const auto start = Clock::now();
+        while(!p) {
+            THREAD_YIELD();
+            p = pushOrPop();
+        }
+        wait += getMsec(start, Clock::now());
+        return p;
+    }
+
+    // 手牌の番号を13牌の文字列にしてstrに追記する
+    void appendHand(HandNumber number, std::string& str) {
+        constexpr SizeType SizeOfHandTiles = SizeOfCompleteTiles - 1;
+        for(SizeType index = 0; index < SizeOfHandTiles; ++index) {
+            str += static_cast<char>('0' + ((number >> ((SizeOfHandTiles - 1 - index) * 4)) & 0xf));
+        }
+        return;
+    }
+
+    class Pipeline {
+    public:
+        Pipeline(const PipelineConfig& config, const HandFilter& filter) :
+            config_(config), filter_(filter),
+            batchSize_(std::min(std::max(config.batchSize, static_cast<SizeType>(1)), MaxPipelineBatchSize)),
+            sizeOfSolvers_(std::max(config.sizeOfSolvers, static_cast<SizeType>(1))),
+            sizeOfBatches_((SizeOfAllHands + batchSize_ - 1) / batchSize_),
+            handQueue_(std::max(config.queueDepth, sizeOfSolvers_)),
+            solverTimeSet_(sizeOfSolvers_) {
+            for(SizeType i = 0; i < sizeOfSolvers_; ++i) {
+                textQueueSet_.push_back(std::unique_ptr<SpscRing<TextBatch>>(
+                                            new SpscRing<TextBatch>(config.queueDepth)));
+            }
+            return;
+        }
+
+        // 全手牌を解いてosに書き出し、書き出した手牌の数を返す
+        SizeType Run(std::ostream& os) {
+            std::vector<THREAD_FUTURE<void>> futureSet;
+            futureSet.push_back(THREAD_ASYNC(THREAD_LAUNCH_ASYNC, [this](void) -> void { generate(); }));
+            for(SizeType index = 0; index < sizeOfSolvers_; ++index) {
+                futureSet.push_back(THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                                                 [this, index](void) -> void { solve(index); }));
+            }
+
+            const auto sizeOfHands = write(os);
+            for(auto& f : futureSet) {
+                f.get();
+            }
+            return sizeOfHands;
+        }
+
+        void PrintReport(std::ostream& os) const {
+            os << "pipeline: " << sizeOfSolvers_ << " solvers, batch size " << batchSize_
+               << ", queue depth " << config_.queueDepth << "\n" << std::fixed << std::setprecision(1);
+            generatorTime_.Print("generator", os);
+            for(SizeType index = 0; index < sizeOfSolvers_; ++index) {
+                const std::string name = "solver " + std::to_string(index);
+                solverTimeSet_.at(index).Print(name.c_str(), os);
+            }
+            writerTime_.Print("writer", os);
+            os << std::defaultfloat;
+            return;
+        }
+
+    private:
+        // 手牌を番号順にbatchSize_個ずつ作って渡し、最後に解く段の数だけ終わりの印を渡す
+        void generate(void) {
+            const auto start = Clock::now();
+            SizeType rank = 0;
+            for(SizeType sequence = 0; sequence < (sizeOfBatches_ + sizeOfSolvers_); ++sequence) {
+                SizeType position = 0;
+                auto batch = waitFor([this, &position](void) { return handQueue_.BeginPush(position); },
+                                     generatorTime_.wait);
+                batch->sequence = sequence;
+                batch->size = std::min(batchSize_, SizeOfAllHands - rank);
+                for(SizeType i = 0; i < batch->size; ++i, ++rank) {
+                    batch->handSet[i] = GetHandNumber(rank);
+                }
+                handQueue_.EndPush(position);
+            }
+
+            generatorTime_.batches = sizeOfBatches_;
+            generatorTime_.total = getMsec(start, Clock::now());
+            return;
+        }
+
+        void solve(SizeType index) {
+            const auto start = Clock::now();
+            auto& time = solverTimeSet_.at(index);
+            auto& textQueue = *textQueueSet_.at(index);
+            WaitResult result;
+
+            for(;;) {
+                SizeType position = 0;
+                const auto batch = waitFor([this, &position](void) { return handQueue_.BeginPop(position); },
+                                           time.wait);
+                if (batch->size == 0) {
+                    handQueue_.EndPop(position);
+                    break;
+                }
+
+                auto text = waitFor([&textQueue](void) { return textQueue.BeginPush(); }, time.wait);
+                text->sequence = batch->sequence;
+                text->sizeOfHands = 0;
+                text->text.clear();
+                for(SizeType i = 0; i < batch->size; ++i) {
+                    const auto number = batch->handSet[i];
+                    if (!filter_.AcceptsTiles(HandToTileMap(number))) {
+                        continue;
+                    }
+
+                    SolveHand(number, result);
+                    if (filter_.AcceptsWaits(result)) {
+                        appendHand(number, text->text);
+                        text->text += ":\n";
+                        PrintWaitKeys(result.keys.begin(), result.keys.size(), text->text);
+                        ++text->sizeOfHands;
+                    }
+                }
+
+                handQueue_.EndPop(position);
+                textQueue.EndPush();
+                ++time.batches;
+            }
+
+            time.total = getMsec(start, Clock::now());
+            return;
+        }
+
+        // 解く段の先頭から、通し番号順に書き出す
+        SizeType write(std::ostream& os) {
+            const auto start = Clock::now();
+            SizeType sizeOfHands = 0;
+            for(SizeType sequence = 0; sequence < sizeOfBatches_; ++sequence) {
+                auto queue = waitFor([this, sequence](void) -> SpscRing<TextBatch>* {
+                        for(auto& queue : textQueueSet_) {
+                            const auto front = queue->Peek();
+                            if (front && (front->sequence == sequence)) {
+                                return queue.get();
+                            }
+                        }
+                        return nullptr;
+                    }, writerTime_.wait);
+
+                // 書き出してから枠を返す
+                const auto text = queue->Peek();
+                os << text->text;
+                sizeOfHands += text->sizeOfHands;
+                queue->Pop();
+            }
+
+            writerTime_.batches = sizeOfBatches_;
+            writerTime_.total = getMsec(start, Clock::now());
+            return sizeOfHands;
+        }
+
+        const PipelineConfig config_;
+        const HandFilter filter_;
+        const SizeType batchSize_;
+        const SizeType sizeOfSolvers_;
+        const SizeType sizeOfBatches_;
+        MpmcRing<HandBatch> handQueue_;
+        std::vector<std::unique_ptr<SpscRing<TextBatch>>> textQueueSet_;
+        StageTime generatorTime_;
+        std::vector<StageTime> solverTimeSet_;
+        StageTime writerTime_;
+    };
+}
+
+namespace TileSetSolver {
+    SizeType SolvePipelined(const PipelineConfig& config, const HandFilter& filter,
+                            std::ostream& os, std::ostream* report) {
+        std::unique_ptr<Pipeline> pipeline(new Pipeline(config, filter));
+        const auto sizeOfHands = pipeline->Run(os);
+        if (report) {
+            pipeline->PrintReport(*report);
+        }
+        return sizeOfHands;
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,188 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * スレッドを論理CPUに固定する
+ * Linuxではsysfsから論理CPUの物理コアとNUMAノードを調べる。それ以外の環境では何もしない。
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "countTilesBits.hpp"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+using namespace TileSetSolver;
+
+namespace {
+    // 論理CPUの番号の上限(この値は含まない)。cpu_set_tに入らない番号は固定できない。
+#ifdef __linux__
+    constexpr long SizeOfCpuNumbers = CPU_SETSIZE;
+#else
+    constexpr long SizeOfCpuNumbers = 1024;
+#endif
+
+    // strから論理CPUの番号を読んで、読んだ次の文字の位置をpLastに格納する
+    // 数字がないか、番号が範囲外ならfalseを返す
+    bool parseCpuNumber(const char* str, const char*& pLast, long& cpu) {
+        char* pEnd = nullptr;
+        cpu = std::strtol(str, &pEnd, 10);
+        pLast = pEnd;
+        return (pEnd != str) && (*str != '-') && (*str != '+') && (cpu >= 0) && (cpu < SizeOfCpuNumbers);
+    }
+
+#ifdef __linux__
+    const std::string SysfsCpuDir = "/sys/devices/system/cpu/";
+
+    // sysfsから整数を一つ読む。読めなければ-1を返す。
+    int readSysfsInt(const std::string& path) {
+        std::ifstream ifs(path);
+        int value = -1;
+        if (!(ifs >> value)) {
+            return -1;
+        }
+        return value;
+    }
+
+    // 論理CPUが属するNUMAノードを返す。分からなければ-1を返す。
+    int getNumaNode(int cpu) {
+        const std::string dirName = SysfsCpuDir + "cpu" + std::to_string(cpu);
+        DIR* pDir = opendir(dirName.c_str());
+        if (!pDir) {
+            return -1;
+        }
+
+        int node = -1;
+        while(struct dirent* pEntry = readdir(pDir)) {
+            const std::string name = pEntry->d_name;
+            if ((name.find("node") == 0) && (name.size() > 4)) {
+                node = std::atoi(name.c_str() + 4);
+                break;
+            }
+        }
+
+        closedir(pDir);
+        return node;
+    }
+#endif
+
+    // 稼働中の論理CPUの一覧を返す
+    std::vector<int> getOnlineCpus(void) {
+        std::vector<int> cpuSet;
+#ifdef __linux__
+        std::ifstream ifs(SysfsCpuDir + "online");
+        std::string line;
+        if (std::getline(ifs, line) && ParseCpuList(line, cpuSet)) {
+            return cpuSet;
+        }
+#endif
+        return cpuSet;
+    }
+}
+
+namespace TileSetSolver {
+    bool ParseCpuList(const std::string& str, std::vector<int>& cpuSet) {
+        std::istringstream is(str);
+        std::string range;
+
+        while(std::getline(is, range, ',')) {
+            if (range.empty()) {
+                return false;
+            }
+
+            // 番号が大きすぎる範囲や逆順の範囲は、展開する前に拒む
+            const char* pLast = nullptr;
+            long first = 0;
+            if (!parseCpuNumber(range.c_str(), pLast, first)) {
+                return false;
+            }
+
+            long last = first;
+            if ((*pLast == '-') && !parseCpuNumber(pLast + 1, pLast, last)) {
+                return false;
+            }
+
+            if ((*pLast != 0) || (last < first)) {
+                return false;
+            }
+
+            for(auto cpu = first; cpu <= last; ++cpu) {
+                cpuSet.push_back(static_cast<int>(cpu));
+            }
+        }
+
+        return !cpuSet.empty();
+    }
+
+    CpuPlacement GetCpuPlacement(int cpu) {
+        CpuPlacement placement {cpu, -1, -1, -1};
+#ifdef __linux__
+        const std::string topologyDir = SysfsCpuDir + "cpu" + std::to_string(cpu) + "/topology/";
+        placement.package = readSysfsInt(topologyDir + "physical_package_id");
+        placement.core = readSysfsInt(topologyDir + "core_id");
+        placement.node = getNumaNode(cpu);
+#endif
+        return placement;
+    }
+
+    std::vector<int> GetPhysicalCoreCpus(const std::vector<int>& candidates) {
+        const auto cpuSet = candidates.empty() ? getOnlineCpus() : candidates;
+        std::set<std::pair<int, int>> coreSet;
+        std::vector<int> result;
+
+        // SMTの兄弟スレッドのうち、最初に現れた論理CPUだけ使う
+        for(auto cpu : cpuSet) {
+            const auto placement = GetCpuPlacement(cpu);
+            if ((placement.core < 0) || coreSet.insert(std::make_pair(placement.package, placement.core)).second) {
+                result.push_back(cpu);
+            }
+        }
+
+        return result;
+    }
+
+    bool PinCurrentThread(int cpu) {
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        return (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0);
+#else
+        return false;
+#endif
+    }
+
+    bool UseLocalMemory(void) {
+#ifdef __linux__
+        // 以後このスレッドが確保するページを、実行中のCPUのNUMAノードに置く
+        // libnumaに依存しないように、<numaif.h>ではなくカーネルのヘッダの定数を使う
+        return (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == 0);
+#else
+        return false;
+#endif
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,631 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * Unixドメインソケットで待ちの問い合わせを受け付けるサーバと、負荷をかけるクライアント
+ *
+ * 要求と応答は一行ずつのテキストで、応答は空行で終わる
+ *   13牌の数字 : 手牌と待ち(ログと同じ形式)を返す。手牌として正しくなければ"(invalid input)"を返す。
+ *   STATS      : 受け付けた要求の数、要求を処理する時間の分位点(50%, 99%, 99.9%)と、
+ *                前回のSTATS(初回は待ち受けを始めたとき)から後の毎秒の要求数を返す
+ *   SHUTDOWN   : サーバを終了する
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+#ifndef USE_BOOST_THREAD
+#include <cerrno>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace TileSetSolver;
+
+#ifndef USE_BOOST_THREAD
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // 応答の終わり
+    const std::string EndOfResponse = "\n";
+    const std::string CommandStats = "STATS";
+    const std::string CommandShutdown = "SHUTDOWN";
+    const std::string ResponseForInvalidInput = "(invalid input)\n";
+
+    // 記述子が足りなくて受け付けられなかったときに、受け付けを休む時間
+    constexpr int AcceptBackoffMsec = 100;
+    // 応答を書き出せないまま待つ時間の上限
+    constexpr long SendTimeoutSeconds = 10;
+
+#ifdef MSG_NOSIGNAL
+    constexpr int SendFlags = MSG_NOSIGNAL;  // 切断された相手に書いてもSIGPIPEで終了しない
+#else
+    constexpr int SendFlags = 0;
+#endif
+
+    // 経過時間をナノ秒で返す
+    inline uint64_t getElapsedNanoseconds(Clock::time_point start) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    // ソケットからの入力を一行ずつ取り出す
+    class LineReader {
+    public:
+        explicit LineReader(int fd) : fd_(fd) {
+            return;
+        }
+
+        // 一行読んで改行を除いてlineに入れる。接続が切れたらfalseを返す。
+        bool Read(std::string& line) {
+            for(;;) {
+                const auto pos = buffer_.find('\n');
+                if (pos != std::string::npos) {
+                    line = buffer_.substr(0, pos);
+                    buffer_.erase(0, pos + 1);
+                    if (!line.empty() && (line.back() == '\r')) {
+                        line.pop_back();
+                    }
+                    return true;
+                }
+
+                char chunk[4096];
+                const auto size = ::read(fd_, chunk, sizeof(chunk));
+                if (size <= 0) {
+                    return false;
+                }
+                buffer_.append(chunk, static_cast<std::string::size_type>(size));
+            }
+        }
+
+    private:
+        int fd_;
+        std::string buffer_;
+    };
+
+    // すべて書き出せなければfalseを返す
+    bool writeAll(int fd, const std::string& str) {
+        const char* p = str.data();
+        auto rest = str.size();
+        while(rest > 0) {
+            const auto size = ::send(fd, p, rest, SendFlags);
+            if (size <= 0) {
+                return false;
+            }
+            p += size;
+            rest -= static_cast<decltype(rest)>(size);
+        }
+        return true;
+    }
+
+    // pathに接続したソケットを返す。接続できなければ-1を返す。
+    int connectTo(const std::string& path) {
+        sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // 毎秒の要求数を返す
+    double getRate(uint64_t count, double seconds) {
+        return (seconds > 0) ? (static_cast<double>(count) / seconds) : 0.0;
+    }
+
+    // 要求の数、毎秒の要求数、分位点をマイクロ秒で書き出す
+    void printLatency(const LatencyHistogram& histogram, double qps, std::ostream& os) {
+        os << std::fixed << std::setprecision(3)
+           << "requests " << histogram.GetCount() << "\n"
+           << "qps " << qps << "\n"
+           << "p50_us " << (static_cast<double>(histogram.GetPercentile(50.0)) / 1000.0) << "\n"
+           << "p99_us " << (static_cast<double>(histogram.GetPercentile(99.0)) / 1000.0) << "\n"
+           << "p999_us " << (static_cast<double>(histogram.GetPercentile(99.9)) / 1000.0) << "\n"
+           << "max_us " << (static_cast<double>(histogram.GetMax()) / 1000.0) << "\n";
+        return;
+    }
+
+    // すべての手牌の待ちを番号順に持つ
+    // 実行ファイルに埋め込んだ表があればそれを使い、なければ一度だけ求める
+    class WaitTable {
+    public:
+        explicit WaitTable(SizeType sizeOfThreads) : embedded_(GetEmbeddedWaitTable(view_)) {
+            if (!embedded_) {
+                data_ = BuildWaitTable(sizeOfThreads);
+                view_.Attach(data_.data(), data_.size(), false);
+            }
+        }
+
+        bool IsEmbedded(void) const {
+            return embedded_;
+        }
+
+        // 手牌と待ちをresponseに書く
+        void Find(HandNumber number, std::string& response) const {
+            response.clear();
+            view_.Print(GetHandRank(number), response);
+            return;
+        }
+
+    private:
+        WaitTableView view_;
+        bool embedded_;
+        std::vector<char> data_;
+    };
+
+    // 接続ごとの状態。読んだが改行に届いていない入力を持つ。
+    struct Connection {
+        explicit Connection(int fdArg) : fd(fdArg) {
+            return;
+        }
+
+        int fd;
+        std::string buffer;
+    };
+
+    using ConnectionPtr = std::unique_ptr<Connection>;
+
+    // 接続を受け付けて、要求が届いた接続をワーカースレッドに処理させる
+    // ワーカースレッドは届いている要求に応えたら接続を返すので、待っているだけの接続はスレッドを占めない
+    class WaitServer {
+    public:
+        WaitServer(const WaitTable& table, SizeType sizeOfWorkers) :
+            table_(table), histogramSet_(sizeOfWorkers), mutexSet_(sizeOfWorkers),
+            listenFd_(-1), closed_(false), shutdown_(false), statsTime_(Clock::now()), statsCount_(0) {
+            wakeFdSet_[0] = -1;
+            wakeFdSet_[1] = -1;
+            return;
+        }
+
+        bool Run(const std::string& path, std::ostream& log) {
+            sockaddr_un addr;
+            if (path.size() >= sizeof(addr.sun_path)) {
+                log << "Too long socket path: " << path << "\n";
+                return false;
+            }
+
+            listenFd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listenFd_ < 0) {
+                log << "Cannot create a socket\n";
+                return false;
+            }
+
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            ::unlink(path.c_str());
+            if ((::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) ||
+                (::listen(listenFd_, SOMAXCONN) != 0)) {
+                log << "Cannot listen on " << path << "\n";
+                ::close(listenFd_);
+                return false;
+            }
+
+            // ワーカースレッドが接続を返したときと、終了するときに、pollを起こす
+            if (::pipe(wakeFdSet_) != 0) {
+                log << "Cannot create a pipe\n";
+                ::close(listenFd_);
+                return false;
+            }
+            ::fcntl(wakeFdSet_[0], F_SETFL, ::fcntl(wakeFdSet_[0], F_GETFL) | O_NONBLOCK);
+            ::fcntl(wakeFdSet_[1], F_SETFL, ::fcntl(wakeFdSet_[1], F_GETFL) | O_NONBLOCK);
+
+            log << "Listening on " << path << " with " << histogramSet_.size() << " workers\n";
+            statsTime_ = Clock::now();
+
+            std::vector<THREAD_FUTURE<void>> futureSet;
+            for(SizeType index = 0; index < histogramSet_.size(); ++index) {
+                futureSet.push_back(
+                    THREAD_ASYNC(THREAD_LAUNCH_ASYNC, [this, index](void) -> void { work(index); }));
+            }
+
+            std::vector<ConnectionPtr> idleSet;
+            const bool success = dispatch(idleSet, log);
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                closed_ = true;
+                queueCondition_.notify_all();
+            }
+
+            for(auto& f : futureSet) {
+                f.get();
+            }
+
+            // 要求を待っている接続と、ワーカースレッドから戻った接続を閉じる
+            for(auto& connection : idleSet) {
+                ::close(connection->fd);
+            }
+            for(auto& connection : returnedSet_) {
+                ::close(connection->fd);
+            }
+
+            ::close(wakeFdSet_[0]);
+            ::close(wakeFdSet_[1]);
+            ::close(listenFd_);
+            ::unlink(path.c_str());
+            log << "Shut down\n";
+            return success;
+        }
+
+    private:
+        // 接続を受け付けて、要求が届いた接続をワーカースレッドに渡す。終了を指示されるまで続ける。
+        // 受け付けられない状態が続くならfalseを返す。
+        bool dispatch(std::vector<ConnectionPtr>& idleSet, std::ostream& log) {
+            auto acceptResumeTime = Clock::now();
+            std::vector<pollfd> pollSet;
+
+            while(!shutdown_.load()) {
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex_);
+                    for(auto& connection : returnedSet_) {
+                        idleSet.push_back(std::move(connection));
+                    }
+                    returnedSet_.clear();
+                }
+
+                // 記述子が足りなくて受け付けられなかったら、しばらく受け付けない
+                const bool accepting = (Clock::now() >= acceptResumeTime);
+                pollSet.clear();
+                pollSet.push_back(pollfd {wakeFdSet_[0], POLLIN, 0});
+                pollSet.push_back(pollfd {accepting ? listenFd_ : -1, POLLIN, 0});
+                for(auto& connection : idleSet) {
+                    pollSet.push_back(pollfd {connection->fd, POLLIN, 0});
+                }
+
+                if (::poll(pollSet.data(), pollSet.size(), accepting ? -1 : AcceptBackoffMsec) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    log << "Cannot poll: " << std::strerror(errno) << "\n";
+                    return false;
+                }
+
+                if (pollSet.at(0).revents != 0) {
+                    char buffer[256];
+                    while(::read(wakeFdSet_[0], buffer, sizeof(buffer)) > 0) {
+                    }
+                }
+
+                // 要求が届いたか切断された接続をワーカースレッドに渡して、残りは待ち続ける
+                std::vector<ConnectionPtr> waitingSet;
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex_);
+                    for(SizeType index = 0; index < idleSet.size(); ++index) {
+                        if (pollSet.at(index + 2).revents != 0) {
+                            queue_.push_back(std::move(idleSet.at(index)));
+                            queueCondition_.notify_one();
+                        } else {
+                            waitingSet.push_back(std::move(idleSet.at(index)));
+                        }
+                    }
+                }
+                idleSet.swap(waitingSet);
+
+                if ((pollSet.at(1).revents & POLLIN) == 0) {
+                    continue;
+                }
+
+                const int fd = ::accept(listenFd_, nullptr, nullptr);
+                if (fd >= 0) {
+                    // 応答を読まない相手に書き続けて、ワーカースレッドが止まらないようにする
+                    timeval timeout {SendTimeoutSeconds, 0};
+                    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    idleSet.push_back(ConnectionPtr(new Connection(fd)));
+                } else if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+                    acceptResumeTime = Clock::now() + std::chrono::milliseconds(AcceptBackoffMsec);
+                } else if ((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != ECONNABORTED)) {
+                    log << "Cannot accept: " << std::strerror(errno) << "\n";
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // 要求が届いた接続を一つずつ取り出して、届いている要求に応える
+        void work(SizeType index) {
+            for(;;) {
+                ConnectionPtr connection;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex_);
+                    queueCondition_.wait(lock, [this](void) { return closed_ || !queue_.empty(); });
+                    if (queue_.empty()) {
+                        return;
+                    }
+                    connection = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+
+                if (!serve(index, *connection)) {
+                    ::close(connection->fd);
+                    continue;
+                }
+
+                // 終了するときは、次の要求を待たずに閉じる
+                std::lock_guard<std::mutex> lock(queueMutex_);
+                if (closed_) {
+                    ::close(connection->fd);
+                    continue;
+                }
+                returnedSet_.push_back(std::move(connection));
+                wake();
+            }
+        }
+
+        // 一度だけ読んで、届いている要求にすべて応える。接続を閉じるならfalseを返す。
+        bool serve(SizeType index, Connection& connection) {
+            char chunk[4096];
+            const auto size = ::read(connection.fd, chunk, sizeof(chunk));
+            if (size <= 0) {
+                return false;
+            }
+            connection.buffer.append(chunk, static_cast<std::string::size_type>(size));
+
+            std::string line;
+            std::string response;
+            std::string::size_type pos = 0;
+            while((pos = connection.buffer.find('\n')) != std::string::npos) {
+                line = connection.buffer.substr(0, pos);
+                connection.buffer.erase(0, pos + 1);
+                if (!line.empty() && (line.back() == '\r')) {
+                    line.pop_back();
+                }
+                if (line.empty()) {
+                    continue;
+                }
+
+                if (line == CommandStats) {
+                    response = getStats();
+                } else if (line == CommandShutdown) {
+                    writeAll(connection.fd, EndOfResponse);
+                    shutdown_.store(true);
+                    wake();
+                    return false;
+                } else {
+                    const auto start = Clock::now();
+                    HandNumber number = 0;
+                    if (ParseHand(line, number)) {
+                        table_.Find(number, response);
+                    } else {
+                        response = ResponseForInvalidInput;
+                    }
+                    response += EndOfResponse;
+                    const auto elapsed = getElapsedNanoseconds(start);
+
+                    std::lock_guard<std::mutex> lock(mutexSet_.at(index));
+                    histogramSet_.at(index).Record(elapsed);
+                }
+
+                if (!writeAll(connection.fd, response)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // pollを起こす。パイプが一杯なら、既に起こしてある。
+        void wake(void) {
+            const char byte = 0;
+            const auto size = ::write(wakeFdSet_[1], &byte, 1);
+            (void)size;
+            return;
+        }
+
+        std::string getStats(void) {
+            LatencyHistogram histogram;
+            for(SizeType index = 0; index < histogramSet_.size(); ++index) {
+                std::lock_guard<std::mutex> lock(mutexSet_.at(index));
+                histogram.Merge(histogramSet_.at(index));
+            }
+
+            // 前回のSTATSから後の要求だけで毎秒の要求数を求める
+            double qps = 0.0;
+            {
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                const auto now = Clock::now();
+                const auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(now - statsTime_).count();
+                const auto count = histogram.GetCount();
+                qps = getRate(count - statsCount_, static_cast<double>(nsec) / 1e9);
+                statsTime_ = now;
+                statsCount_ = count;
+            }
+
+            std::ostringstream os;
+            printLatency(histogram, qps, os);
+            os << EndOfResponse;
+            return os.str();
+        }
+
+        const WaitTable& table_;
+        std::vector<LatencyHistogram> histogramSet_;  // ワーカースレッドごとの処理時間
+        std::vector<std::mutex> mutexSet_;            // histogramSet_の排他制御
+        int listenFd_;
+        int wakeFdSet_[2];                            // pollを起こすパイプ
+        std::deque<ConnectionPtr> queue_;             // 要求が届いた接続
+        std::vector<ConnectionPtr> returnedSet_;      // ワーカースレッドが応え終えた接続
+        std::mutex queueMutex_;                       // queue_, returnedSet_, closed_の排他制御
+        std::condition_variable queueCondition_;
+        bool closed_;                                 // もう要求に応えない
+        std::atomic<bool> shutdown_;
+        std::mutex statsMutex_;                       // statsTime_とstatsCount_の排他制御
+        Clock::time_point statsTime_;                 // 前回STATSを受けた時刻
+        uint64_t statsCount_;                         // 前回STATSを受けたときの要求の数
+    };
+
+    // 空行まで読む
+    bool readResponse(LineReader& reader, std::string& response) {
+        response.clear();
+        std::string line;
+        while(reader.Read(line)) {
+            if (line.empty()) {
+                return true;
+            }
+            response += line;
+            response += "\n";
+        }
+        return false;
+    }
+
+    // 一つの接続から、ランダムな手牌をsizeOfRequests個問い合わせる
+    bool requestHands(const std::string& path, SizeType index, SizeType sizeOfRequests,
+                      LatencyHistogram& histogram) {
+        const int fd = connectTo(path);
+        if (fd < 0) {
+            return false;
+        }
+
+        std::mt19937_64 engine(index + 1);
+        std::uniform_int_distribution<SizeType> distribution(0, SizeOfAllHands - 1);
+        LineReader reader(fd);
+        std::string response;
+        bool success = true;
+
+        for(SizeType i = 0; success && (i < sizeOfRequests); ++i) {
+            const auto hand = HandToString(GetHandNumber(distribution(engine)));
+            const auto start = Clock::now();
+            success = writeAll(fd, hand + "\n") && readResponse(reader, response) &&
+                (response.compare(0, hand.size(), hand) == 0);
+            histogram.Record(getElapsedNanoseconds(start));
+        }
+
+        ::close(fd);
+        return success;
+    }
+
+    // 一つの命令を送って応答を返す
+    bool sendCommand(const std::string& path, const std::string& command, std::string& response) {
+        const int fd = connectTo(path);
+        if (fd < 0) {
+            return false;
+        }
+
+        LineReader reader(fd);
+        const bool success = writeAll(fd, command + "\n") && readResponse(reader, response);
+        ::close(fd);
+        return success;
+    }
+}
+
+namespace TileSetSolver {
+    bool RunServer(const std::string& path, SizeType sizeOfThreads, std::ostream& log) {
+        sizeOfThreads = std::max(sizeOfThreads, static_cast<SizeType>(1));
+
+        const auto start = Clock::now();
+        WaitTable table(sizeOfThreads);
+        log << (table.IsEmbedded() ? "Loaded the embedded" : "Built the") << " wait table in "
+            << (static_cast<double>(getElapsedNanoseconds(start)) / 1e6) << " ms\n";
+
+        WaitServer server(table, sizeOfThreads);
+        return server.Run(path, log);
+    }
+
+    bool RunClient(const std::string& path, SizeType sizeOfConnections, SizeType sizeOfRequests,
+                   bool shutdown, std::ostream& os) {
+        sizeOfConnections = std::max(sizeOfConnections, static_cast<SizeType>(1));
+        std::vector<LatencyHistogram> histogramSet(sizeOfConnections);
+        std::vector<THREAD_FUTURE<bool>> futureSet;
+
+        const auto start = Clock::now();
+        for(SizeType index = 0; index < sizeOfConnections; ++index) {
+            // 要求の数を接続に振り分ける
+            const auto size = sizeOfRequests / sizeOfConnections + ((index < (sizeOfRequests % sizeOfConnections)) ? 1 : 0);
+            futureSet.push_back(
+                THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                             [&path, &histogramSet, index, size](void) -> bool
+                             { return requestHands(path, index, size, histogramSet.at(index)); }));
+        }
+
+        bool success = true;
+        for(auto& f : futureSet) {
+            success &= f.get();
+        }
+        const auto seconds = static_cast<double>(getElapsedNanoseconds(start)) / 1e9;
+
+        LatencyHistogram histogram;
+        for(auto& h : histogramSet) {
+            histogram.Merge(h);
+        }
+
+        os << "client (round trip)\n";
+        printLatency(histogram, getRate(histogram.GetCount(), seconds), os);
+
+        std::string response;
+        if (sendCommand(path, CommandStats, response)) {
+            os << "server (lookup)\n" << response;
+        } else {
+            success = false;
+        }
+
+        if (shutdown) {
+            success &= sendCommand(path, CommandShutdown, response);
+        }
+
+        if (!success) {
+            os << "Failed to query " << path << "\n";
+        }
+        return success;
+    }
+}
+
+#else // USE_BOOST_THREAD
+namespace TileSetSolver {
+    bool RunServer(const std::string& path, SizeType sizeOfThreads, std::ostream& log) {
+        (void)path;
+        (void)sizeOfThreads;
+        log << "Unix domain sockets are not supported\n";
+        return false;
+    }
+
+    bool RunClient(const std::string& path, SizeType sizeOfConnections, SizeType sizeOfRequests,
+                   bool shutdown, std::ostream& os) {
+        (void)path;
+        (void)sizeOfConnections;
+        (void)sizeOfRequests;
+        (void)shutdown;
+        os << "Unix domain sockets are not supported\n";
+        return false;
+    }
+}
+#endif // USE_BOOST_THREAD
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
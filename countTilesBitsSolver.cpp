@@ -5,7 +5,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <nmmintrin.h>
 #include "countTilesBits.hpp"
 
@@ -167,6 +172,49 @@ private:
     bool    open_;     // 待ち型
 };
 
+// 待ち形のキーの集合
+// 一手牌の待ち形の数には上限があるので、スタック上の固定長ハッシュ表で重複を検出する
+class TileKeySet {
+public:
+    inline TileKeySet(void) : size_(0) {
+        // キーは待ち形のビットを必ず含むので0にはならない
+        slots_.fill(0);
+        return;
+    }
+
+    // keyが未登録なら登録してtrueを、登録済ならfalseを返す
+    inline bool Insert(TileKey key) {
+        // 黄金比の乗算ハッシュの上位ビットを、最初に調べる位置にする
+        SizeType pos = static_cast<SizeType>((key * 0x9e3779b97f4a7c15ull) >> (64 - SizeOfSlotsBits));
+        for(;;) {
+            const auto slot = slots_[pos];
+            if (slot == key) {
+                return false;
+            }
+            if (slot == 0) {
+                break;
+            }
+            pos = (pos + 1) & (SizeOfSlots - 1);
+        }
+
+        if (size_ >= MaxSizeOfWaits) {
+            throw std::length_error("Too many waits");
+        }
+
+        slots_[pos] = key;
+        ++size_;
+        return true;
+    }
+
+private:
+    static constexpr SizeType SizeOfSlotsBits = 6;
+    static constexpr SizeType SizeOfSlots = 1 << SizeOfSlotsBits;
+    static_assert(SizeOfSlots >= (MaxSizeOfWaits * 2), "Too small hash table");
+
+    std::array<TileKey, SizeOfSlots> slots_;  // 0なら空き
+    SizeType size_;                           // 登録済のキーの数
+};
+
 // 対子 + 刻子または順子 * 4
 class TileFullSet {
 public:
@@ -184,11 +232,21 @@ public:
         return;
     }
 
-    inline void Filter(TileIndex extra, KeyArray& keyArray, ResultStringArray& stringArray) {
+    inline void Filter(TileIndex extra, TileKeySet& keySet, WaitKeyArray& keyArray) {
         TileMap mask = 0xf;
         mask <<= ((extra - 1) * SizeOfBitsPerTile);
 
+        // 完成形のキーを一度だけ求めて整列しておく
+        // 下位ビットに何組目かを入れて、どれを待ち形にしたか分かるようにする
+        std::array<TileKey, SizeOfTileSet> sortedKeys;
         SizeType i = 0;
+        for(auto& tileSet : tileSetArray_) {
+            sortedKeys[i] = (tileSet.GetKey() << SizeOfIndexBits) | i;
+            ++i;
+        }
+        sortKeys(sortedKeys);
+
+        i = 0;
         for(auto& tileSet : tileSetArray_) {
             TileMap newTileMap;
             const auto oldTileSet = tileSet.GetValue();
@@ -203,16 +261,17 @@ public:
                 :"=&r"(newTileMap):"r"(oldTileSet),"r"(mask):"r15");
 
             if (newTileMap != oldTileSet) {
-                TileSet newSet(newTileMap, true);
-                auto newFullSet = *this;
-                newFullSet.Set(newSet, i);
-
-                auto key = newFullSet.GetKey();
-                if (std::find_if(keyArray.begin(), keyArray.end(),
-                                 [&](TileKey arg) -> bool
-                                 {return (arg == key); }) == keyArray.end()) {
+                // 待ち形だけ求め直して、残りの完成形は降順に連結する
+                TileKey key = TileSet(newTileMap, true).GetKey();
+                for(SizeType j = SizeOfTileSet; j > 0; --j) {
+                    const auto sortedKey = sortedKeys[j - 1];
+                    if ((sortedKey & IndexMask) != i) {
+                        key = (key << SizeOfKeyBits) | (sortedKey >> SizeOfIndexBits);
+                    }
+                }
+
+                if (keySet.Insert(key)) {
                     keyArray.push_back(key);
-                    stringArray.push_back(TileFullSet::Print(key));
                 }
             }
             ++i;
@@ -221,85 +280,6 @@ public:
         return;
     }
 
-    inline TileKey GetKey(void) {
-        TileKey openKey = 0;
-        TileKey key1 = 0;
-        TileKey key2 = 0;
-        TileKey key3 = 0;
-        TileKey key4 = 0;
-        SizeType i = 0;
-
-        for(auto& tileSet : tileSetArray_) {
-            TileKey tileKey = tileSet.GetKey();
-
-            if ((tileKey & OpenKey) != 0) {
-                openKey = tileKey;
-                continue;
-            }
-
-            // 挿入ソート
-            switch(i) {
-            case 1:
-                key2 = tileKey;
-                asm (
-                    "mov    r15, %0 \n\t"
-                    "cmp    %1,  %0 \n\t"
-                    "cmovg  %0,  %1 \n\t"
-                    "cmovg  %1, r15 \n\t"
-                    :"+r"(key1),"+r"(key2)::"r15");
-                break;
-            case 2:
-                key3 = tileKey;
-                asm (
-                    "mov    r15, %1 \n\t"
-                    "cmp    %2,  %1 \n\t"
-                    "cmovg  %1,  %2 \n\t"
-                    "cmovg  %2,  r15 \n\t"
-
-                    "mov    r15, %0 \n\t"
-                    "cmp    %1,  %0 \n\t"
-                    "cmovg  %0,  %1 \n\t"
-                    "cmovg  %1, r15 \n\t"
-                    :"+r"(key1),"+r"(key2),"+r"(key3)::"r15");
-                break;
-            case 3:
-                key4 = tileKey;
-                asm (
-                    "mov    r15, %2 \n\t"
-                    "cmp    %3,  %2 \n\t"
-                    "cmovg  %2,  %3 \n\t"
-                    "cmovg  %3,  r15 \n\t"
-
-                    "mov    r15, %1 \n\t"
-                    "cmp    %2,  %1 \n\t"
-                    "cmovg  %1,  %2 \n\t"
-                    "cmovg  %2,  r15 \n\t"
-
-                    "mov    r15, %0 \n\t"
-                    "cmp    %1,  %0 \n\t"
-                    "cmovg  %0,  %1 \n\t"
-                    "cmovg  %1, r15 \n\t"
-                    :"+r"(key1),"+r"(key2),"+r"(key3),"+r"(key4)::"r15");
-                break;
-            default:
-                key1 = tileKey;
-                break;
-            }
-            ++i;
-        }
-
-        TileKey totalTileKey = openKey;
-        totalTileKey <<= SizeOfKeyBits;
-        totalTileKey |= key1;
-        totalTileKey <<= SizeOfKeyBits;
-        totalTileKey |= key2;
-        totalTileKey <<= SizeOfKeyBits;
-        totalTileKey |= key3;
-        totalTileKey <<= SizeOfKeyBits;
-        totalTileKey |= key4;
-        return totalTileKey;
-    }
-
     inline static ResultString Print(TileKey tileKey) {
         ResultString str;
         SizeType length = 0;
@@ -317,82 +297,276 @@ public:
     }
 
 private:
+    static constexpr SizeType SizeOfIndexBits = 3;  // 何組目かを表すビット数
+    static constexpr TileKey  IndexMask = (1 << SizeOfIndexBits) - 1;
+    static_assert(SizeOfTileSet <= IndexMask, "Too small SizeOfIndexBits");
+
+    // 5要素のソーティングネットワークで昇順に並べる
+    inline static void sortKeys(std::array<TileKey, SizeOfTileSet>& keys) {
+        static_assert(SizeOfTileSet == 5, "Unexpected network size");
+        sortPair(keys[0], keys[3]);
+        sortPair(keys[1], keys[4]);
+        sortPair(keys[0], keys[2]);
+        sortPair(keys[1], keys[3]);
+        sortPair(keys[0], keys[1]);
+        sortPair(keys[2], keys[4]);
+        sortPair(keys[1], keys[2]);
+        sortPair(keys[3], keys[4]);
+        sortPair(keys[2], keys[3]);
+        return;
+    }
+
+    inline static void sortPair(TileKey& lower, TileKey& upper) {
+        const auto minKey = std::min(lower, upper);
+        const auto maxKey = std::max(lower, upper);
+        lower = minKey;
+        upper = maxKey;
+        return;
+    }
+
     std::array<TileSet, SizeOfTileSet> tileSetArray_;
 };
 
 // 対子 + 刻子または順子 * 4 の組
 class Solution {
 public:
-    // fullSetを追加する。元のfullSetは以後使えない。
-    inline void Add(TileFullSet& fullSet) {
-        fullSetArray_.push_back(std::move(fullSet));
+    // fullSetを追加する
+    inline void Add(const TileFullSet& fullSet) {
+        fullSetArray_.push_back(fullSet);
     }
 
     // 決め打ちした牌を除いて解を作る
-    inline void Filter(TileIndex extra, KeyArray& keyArray, ResultStringArray& stringArray) {
+    inline void Filter(TileIndex extra, TileKeySet& keySet, WaitKeyArray& keyArray) {
         for(auto& fullSet : fullSetArray_) {
-            fullSet.Filter(extra, keyArray, stringArray);
+            fullSet.Filter(extra, keySet, keyArray);
         }
     }
 
+    inline bool IsEmpty(void) const {
+        return fullSetArray_.empty();
+    }
+
 private:
-    std::vector<TileFullSet> fullSetArray_;
+    FixedArray<TileFullSet, MaxSizeOfSolutions> fullSetArray_;
 };
 
+namespace {
+    // 全スレッドで、分解を試そうとした(待ち, 対子)の組の数と、分解する前に除いた数
+    std::atomic<uint64_t> triedPairCount {0};
+    std::atomic<uint64_t> prunedPairCount {0};
+
+    // 手牌ごとに解く時間を測るかどうか。測った時間の全スレッドの合計はcountTilesBitsPerf.cppが持つ。
+    std::atomic<bool> solveLatencyEnabled {false};
+    // スレッドごとに測った時間。測らなければnullptr。
+    thread_local SolveLatency* currentSolveLatency = nullptr;
+    // スレッドごとに区間を分けて性能カウンタを数える。数えなければnullptr。
+    thread_local PerfCollector* currentPerfCollector = nullptr;
+
+    inline void switchPerfPhase(PerfPhase phase) {
+        if (currentPerfCollector) {
+            currentPerfCollector->Switch(phase);
+        }
+        return;
+    }
+}
+
 class Puzzle {
+private:
+    // 刻子または順子のバックトラッキング状態
+    enum class SplitStatus {
+        NOT_SEARCHED,       // まだ探していない
+        TRIPLE_SEARCHED,    // 刻子を探した
+        SEQUENCE_SEARCHED,  // 順子を探した
+    };
+
+    // ある深さで取り出した刻子と順子
+    struct SplitFrame {
+        TileMap triple;        // 刻子(なければ0)
+        TileMap tripleRest;    // 刻子を取り出した残り
+        TileMap sequence;      // 順子(なければ0)
+        TileMap sequenceRest;  // 順子を取り出した残り
+        bool    noTriple;      // 以後は順子だけ探す
+        SplitStatus status;    // どちらを探したか
+    };
+
 public:
-    inline Puzzle(TileMap src) : src_(src) {}
+    inline Puzzle(TileMap src) : src_(src), triedPairs_(0), prunedPairs_(0) {}
+
+    // 待ちを求めてresultに格納する。試した(待ち, 対子)の組の数を返す。
+    inline uint64_t Solve(WaitResult& result) {
+        result.waitMask = 0;
+        result.keys.clear();
+        findAll(src_, result);
+        return flushPruneCount();
+    }
+
+    // Solveと同じく待ちを求めて、解いた時間をlatencyに記録する。latencyがnullptrなら全スレッドの合計に足す。
+    inline void SolveMeasured(WaitResult& result, SolveLatency* latency) {
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        const auto branches = Solve(result);
+        const auto nsec = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        const SizeType sizeOfWaits = _mm_popcnt_u64(result.waitMask);
+        if (latency) {
+            latency->Record(nsec, sizeOfWaits, branches);
+        } else {
+            RecordSolveLatency(nsec, sizeOfWaits, branches);
+        }
+        return;
+    }
 
-    inline std::string Find(void){
-        ResultStringArray stringArray;
-        findAll(src_, stringArray);
+    // 待ちを求めて、filterを満たせば、resultを手牌の文字列handにしてから待ちを追記してtrueを返す
+    // filterを満たさなければ文字列を作らずにfalseを返す
+    // 一手牌分の作業領域はすべてスタック上の固定長配列なので、resultの容量が足りていればヒープを確保しない
+    inline bool Find(const HandFilter& filter, const char* hand, std::string& result) {
+        switchPerfPhase(PerfFilter);
+        if (!filter.AcceptsTiles(src_)) {
+            return false;
+        }
 
+        WaitResult waitResult;
+        switchPerfPhase(PerfDecompose);
+        // 測らないときは時刻を読まない
+        if (currentSolveLatency) {
+            SolveMeasured(waitResult, currentSolveLatency);
+        } else {
+            Solve(waitResult);
+        }
+        switchPerfPhase(PerfFilter);
+        const bool found = filter.AcceptsWaits(waitResult);
+        if (found) {
+            switchPerfPhase(PerfPrint);
+            result = hand;
+            Print(waitResult.keys.begin(), waitResult.keys.size(), result);
+        }
+        return found;
+    }
+
+    // 待ち形のキーを文字列にしてresultに追記する
+    inline static void Print(const TileKey* keys, SizeType size, std::string& result) {
         // テスト用に「待ち無し」を返す
-        if (stringArray.empty()) {
-            std::string noneResult {"(none)\n"};
-            return noneResult;
+        if (size == 0) {
+            result += "(none)\n";
+            return;
         }
 
-        std::string result;
-        for(auto str : stringArray) {
+        for(SizeType i = 0; i < size; ++i) {
+            const auto str = TileFullSet::Print(keys[i]);
             result += str.value;
         }
-        return result;
+        return;
+    }
+
+    // 待ち牌の集合(1..9をbit 0..8に置く)だけを求める
+    // 待ち牌ごとに、分解を一つ見つけたら残りの分解は探さない
+    inline TileMap FindWaitMask(void) {
+        TileMap waitMask = 0;
+        auto candidates = getCandidates(src_);
+
+        while(candidates) {
+            const auto position = __builtin_ctzll(candidates);
+            candidates &= candidates - 1;
+            const TileMap newTileMap = addTile(src_, position);
+            if ((newTileMap != 0) && hasCompleteSet(newTileMap)) {
+                waitMask |= static_cast<TileMap>(1) << (position / SizeOfBitsPerTile);
+            }
+        }
+
+        flushPruneCount();
+        return waitMask;
     }
 
 private:
-    // tileMapの待ちを調べる
-    inline void findAll(TileMap tileMap, ResultStringArray& stringArray) {
+    // 数えた(待ち, 対子)の組の数を、全スレッドの合計に足す。足す前の試した数を返す。
+    inline uint64_t flushPruneCount(void) {
+        const auto tried = triedPairs_;
+        triedPairCount.fetch_add(triedPairs_, std::memory_order_relaxed);
+        prunedPairCount.fetch_add(prunedPairs_, std::memory_order_relaxed);
+        triedPairs_ = 0;
+        prunedPairs_ = 0;
+        return tried;
+    }
+
+    // 手牌のどれかの牌から2つ以内にある牌だけが待ちになりうる
+    // 待ちになりうる牌の最下位bit(5n bit目)の集合を返す
+    inline static TileMap getCandidates(TileMap tileMap) {
+        // 牌がある種類の最下位bitを、1種と2種ずらして重ねる
+        const TileMap occupied = tileMap & TileLowerBits;
+        TileMap candidates = occupied;
+        candidates |= (occupied << SizeOfBitsPerTile) | (occupied << (SizeOfBitsPerTile * 2));
+        candidates |= (occupied >> SizeOfBitsPerTile) | (occupied >> (SizeOfBitsPerTile * 2));
+        // 既に4牌ある種類は除く
+        candidates &= ~(tileMap >> (SizeOfOneTile - 1)) & TileLowerBits;
+        return candidates;
+    }
+
+    // tileMapのpositionbit目から始まる種類の牌を1牌増やす。5牌目になるなら0を返す。
+    inline static TileMap addTile(TileMap tileMap, SizeType position) {
         constexpr TileMap mask5th = 0x108421084210ull;  // 1..9のいずれかに5牌目がある
-        TileMap lowerMask = 1;
-        TileMap fullMask = 0x1f;
-        KeyArray keyArray;
+        const TileMap lowerMask = static_cast<TileMap>(1) << position;
+        const TileMap fullMask = static_cast<TileMap>(0x1f) << position;
+        TileMap newTileMap = 0;
 
-        // extraを待ちと決め打ちして調べる
-        for(TileIndex extra=1; extra<=TileMax; ++extra) {
-            TileMap newTileMap = 0;
+        asm (
+            // 1牌増やす
+            "mov   r14, %1  \n\t"
+            "and   r14, %3  \n\t"
+            "andn  r15, %3, %1 \n\t"
+            "shl   r14, 1   \n\t"
+            "or    r14, %2  \n\t"
+            "or    r15, r14 \n\t"
+
+            // 5牌目があったら0を返す
+            "xor   %0, %0 \n\t"
+            "test  %4, r15 \n\t"
+            "cmovz %0, r15 \n\t"
+            :"=&r"(newTileMap):"r"(tileMap),"r"(lowerMask),"r"(fullMask),"r"(mask5th):"r14","r15");
+
+        return newTileMap;
+    }
 
-            asm (
-                // 1牌増やす
-                "mov   r14, %1  \n\t"
-                "and   r14, %3  \n\t"
-                "andn  r15, %3, %1 \n\t"
-                "shl   r14, 1   \n\t"
-                "or    r14, %2  \n\t"
-                "or    r15, r14 \n\t"
-
-                // 5牌目があったら0を返す
-                "xor   %0, %0 \n\t"
-                "test  %4, r15 \n\t"
-                "cmovz %0, r15 \n\t"
-                :"=&r"(newTileMap):"r"(tileMap),"r"(lowerMask),"r"(fullMask),"r"(mask5th):"r14","r15");
+    // tileMapから、lowerMaskの対子を取り除いた残りをrestに入れて、対子を返す
+    // 対子がなければ0を返す
+    inline static TileMap removePair(TileMap tileMap, TileMap lowerMask, TileMap fullMask, TileMap& rest) {
+        TileMap tilePair = 0;
+
+        asm (
+            // 対子を取り除いた残り
+            "andn   %1, %4, %2  \n\t"
+            "mov    r15, %2  \n\t"
+            "and    r15, %4  \n\t"
+            "shr    r15, 2   \n\t"
+            "and    r15, %4  \n\t"
+            "or     %1, r15  \n\t"
+
+            // 対子
+            "mov    r15, %2  \n\t"
+            "and    r15, %3  \n\t"
+
+            // 対子があれば返す
+            "xor    %0, %0   \n\t"
+            "cmp    r15, %3  \n\t"
+            "cmovz  %0, %3   \n\t"
+            :"=&r"(tilePair),"=&r"(rest):"r"(tileMap),"r"(lowerMask),"r"(fullMask):"r15");
+
+        return tilePair;
+    }
 
+    // tileMapの待ちを調べる
+    inline void findAll(TileMap tileMap, WaitResult& result) {
+        TileKeySet keySet;
+        auto candidates = getCandidates(tileMap);
+
+        // extraを待ちと決め打ちして調べる
+        while(candidates) {
+            const auto position = __builtin_ctzll(candidates);
+            candidates &= candidates - 1;
+            const TileIndex extra = position / SizeOfBitsPerTile + 1;
+            const TileMap newTileMap = addTile(tileMap, position);
             if (newTileMap != 0) {
-                findWithExtra(newTileMap, extra, keyArray, stringArray);
+                findWithExtra(newTileMap, extra, keySet, result);
             }
-
-            lowerMask <<= SizeOfBitsPerTile;
-            fullMask <<= SizeOfBitsPerTile;
         }
 
         return;
@@ -400,145 +574,270 @@ private:
 
     // tileMapに待ちextraを決め打ちして待ちを調べる
     inline void findWithExtra(TileMap tileMap, TileMap extra,
-                              KeyArray& keyArray, ResultStringArray& stringArray) {
+                              TileKeySet& keySet, WaitResult& result) {
         TileMap lowerMask = 3;
         TileMap fullMask = 0x1f;
 
         // 1..9 の対子について調べる
         for(TileIndex i=TileMin; i<=TileMax; ++i) {
-            TileMap tilePair = 0;
             TileMap rest = 0;
-
-            asm (
-                // 対子を取り除いた残り
-                "andn   %1, %4, %2  \n\t"
-                "mov    r15, %2  \n\t"
-                "and    r15, %4  \n\t"
-                "shr    r15, 2   \n\t"
-                "and    r15, %4  \n\t"
-                "or     %1, r15  \n\t"
-
-                // 対子
-                "mov    r15, %2  \n\t"
-                "and    r15, %3  \n\t"
-
-                // 対子があれば返す
-                "xor    %0, %0   \n\t"
-                "cmp    r15, %3  \n\t"
-                "cmovz  %0, %3   \n\t"
-                :"=&r"(tilePair),"=&r"(rest):"r"(tileMap),"r"(lowerMask),"r"(fullMask):"r15");
-
+            const TileMap tilePair = removePair(tileMap, lowerMask, fullMask, rest);
             lowerMask <<= SizeOfBitsPerTile;
             fullMask <<= SizeOfBitsPerTile;
 
             if (tilePair) {
+                ++triedPairs_;
+                if (!isSplittable(rest)) {
+                    ++prunedPairs_;
+                    continue;
+                }
+
                 TileFullSet fullSet;
                 Solution solution;
                 TileSet tileSet(tilePair);
                 fullSet.Set(tileSet, 0);
-                splitTileMap(rest, fullSet, 1, false, solution);
-                solution.Filter(extra, keyArray, stringArray);
+                splitTileMap(rest, fullSet, solution);
+                solution.Filter(extra, keySet, result.keys);
+                if (!solution.IsEmpty()) {
+                    result.waitMask |= static_cast<TileMap>(1) << (extra - 1);
+                }
             }
         }
     }
 
-    void splitTileMap(TileMap tileMap, TileFullSet fullSet, SizeType depth, bool noTriple, Solution& solution) {
-        constexpr TileMap tripleLowerMask = 7;   //  111b を
-        constexpr TileMap tripleFullMask  = 15;  // 1111b から取り出して
-        constexpr TileMap tripleUpperMask = 8;   // 1000b を残す
-        constexpr TileMap sequenceLowerMask =  0x421;  //     10000100001b を
-        constexpr TileMap sequenceFullMask  = 0x3def;  // 011110111101111b から取り出して
-        constexpr TileMap sequenceUpperMask = 0x7bde;  // 111101111011110b を残す
+    // 14牌のtileMapが、対子 + (刻子または順子) * 4 に分解できればtrueを返す
+    inline bool hasCompleteSet(TileMap tileMap) {
+        TileMap lowerMask = 3;
+        TileMap fullMask = 0x1f;
+
+        for(TileIndex i=TileMin; i<=TileMax; ++i) {
+            TileMap rest = 0;
+            const TileMap tilePair = removePair(tileMap, lowerMask, fullMask, rest);
+            lowerMask <<= SizeOfBitsPerTile;
+            fullMask <<= SizeOfBitsPerTile;
+
+            if (tilePair) {
+                ++triedPairs_;
+                if (!isSplittable(rest)) {
+                    ++prunedPairs_;
+                    continue;
+                }
+
+                if (canSplitTileMap(rest)) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // 対子を除いたtileMapを、刻子と順子に分解できる見込みがあるかどうかを、分解する前に調べる
+    // 牌が隣り合って続く塊ごとに、牌の数が3の倍数でなければ分解できない
+    inline static bool isSplittable(TileMap tileMap) {
+        // 牌がある種類の5bitをすべて立てると、塊ごとに連続したbit列になる
+        TileMap blocks = (tileMap & TileLowerBits) * 0x1f;
+        while(blocks) {
+            // 最下位の塊を取り出す
+            const TileMap lowest = blocks & (~blocks + 1);
+            const TileMap block = blocks & ~(blocks + lowest);
+            if ((_mm_popcnt_u64(tileMap & block) % 3) != 0) {
+                return false;
+            }
+            blocks &= ~block;
+        }
+
+        return true;
+    }
+
+    // 対子を除いたtileMapを刻子または順子 * 4に分解して、solutionに追加する
+    // 再帰せずに、組の配列を一つだけ持って、深さごとに刻子または順子を上書きして戻る
+    void splitTileMap(TileMap tileMap, TileFullSet& fullSet, Solution& solution) {
+        constexpr SizeType firstDepth = 1;  // 先頭は対子
         constexpr auto finalSizeOfTileSet = SizeOfTileSet - 1;
-        const auto newDepath = depth + 1;
 
-        TileMap triple = 0;
-        TileMap tripleRest = 0;
-        if (!noTriple) {
-            splitWithMask(tileMap, tripleLowerMask, tripleFullMask, tripleUpperMask, triple, tripleRest);
+        std::array<SplitFrame, SizeOfTileSet> frameStack;
+        SizeType depth = firstDepth;
+        expandFrame(tileMap, false, frameStack[depth]);
+
+        for(;;) {
+            auto& frame = frameStack[depth];
+
+            if (depth == finalSizeOfTileSet) {
+                // 残り3牌なので、取り出せたらそのまま解になる
+                if (frame.triple) {
+                    fullSet.Set(frame.triple, depth);
+                    solution.Add(fullSet);
+                }
+
+                if (frame.sequence) {
+                    fullSet.Set(frame.sequence, depth);
+                    solution.Add(fullSet);
+                }
+
+                frame.status = SplitStatus::SEQUENCE_SEARCHED;
+            }
+
+            // 刻子を取り出して次の深さを調べ、戻ってきたら順子を取り出して次の深さを調べる
+            if (frame.status == SplitStatus::NOT_SEARCHED) {
+                frame.status = SplitStatus::TRIPLE_SEARCHED;
+                if (frame.triple) {
+                    fullSet.Set(frame.triple, depth);
+                    ++depth;
+                    expandFrame(frame.tripleRest, frame.noTriple, frameStack[depth]);
+                    continue;
+                }
+            }
+
+            if (frame.status == SplitStatus::TRIPLE_SEARCHED) {
+                frame.status = SplitStatus::SEQUENCE_SEARCHED;
+                if (frame.sequence) {
+                    fullSet.Set(frame.sequence, depth);
+                    ++depth;
+                    expandFrame(frame.sequenceRest, frame.noTriple, frameStack[depth]);
+                    continue;
+                }
+            }
+
+            // この深さは調べ終わったので戻る
+            if (depth == firstDepth) {
+                break;
+            }
+            --depth;
         }
 
-        TileMap sequence = 0;
-        TileMap sequenceRest = 0;
-        splitWithMask(tileMap, sequenceLowerMask, sequenceFullMask, sequenceUpperMask, sequence, sequenceRest);
-
-        noTriple |= (triple == 0);
-        if (depth == finalSizeOfTileSet) {
-            if (triple) {
-                auto newFullSet = fullSet;
-                TileMap tileMap(triple);
-                newFullSet.Set(tileMap, depth);
-                solution.Add(newFullSet);
+        return;
+    }
+
+    // 対子を除いたtileMapを刻子または順子 * 4に分解できればtrueを返す
+    // splitTileMapと同じ順に探して、最初の分解が見つかったら止める
+    bool canSplitTileMap(TileMap tileMap) {
+        constexpr SizeType firstDepth = 1;  // 先頭は対子
+        constexpr auto finalSizeOfTileSet = SizeOfTileSet - 1;
+
+        std::array<SplitFrame, SizeOfTileSet> frameStack;
+        SizeType depth = firstDepth;
+        expandFrame(tileMap, false, frameStack[depth]);
+
+        for(;;) {
+            auto& frame = frameStack[depth];
+
+            // 残り3牌なので、取り出せたら分解できた
+            if (depth == finalSizeOfTileSet) {
+                if (frame.triple || frame.sequence) {
+                    return true;
+                }
+                frame.status = SplitStatus::SEQUENCE_SEARCHED;
             }
 
-            if (sequence) {
-                auto newFullSet = fullSet;
-                TileMap tileMap(sequence);
-                newFullSet.Set(tileMap, depth);
-                solution.Add(newFullSet);
+            if (frame.status == SplitStatus::NOT_SEARCHED) {
+                frame.status = SplitStatus::TRIPLE_SEARCHED;
+                if (frame.triple) {
+                    ++depth;
+                    expandFrame(frame.tripleRest, frame.noTriple, frameStack[depth]);
+                    continue;
+                }
             }
-        } else {
-            if (triple) {
-                auto newFullSet = fullSet;
-                TileMap tileMap(triple);
-                newFullSet.Set(tileMap, depth);
-                splitTileMap(tripleRest, newFullSet, newDepath, noTriple, solution);
+
+            if (frame.status == SplitStatus::TRIPLE_SEARCHED) {
+                frame.status = SplitStatus::SEQUENCE_SEARCHED;
+                if (frame.sequence) {
+                    ++depth;
+                    expandFrame(frame.sequenceRest, frame.noTriple, frameStack[depth]);
+                    continue;
+                }
             }
 
-            if (sequence) {
-                auto newFullSet = fullSet;
-                TileMap tileMap(sequence);
-                newFullSet.Set(tileMap, depth);
-                splitTileMap(sequenceRest, newFullSet, newDepath, noTriple, solution);
+            if (depth == firstDepth) {
+                break;
             }
+            --depth;
         }
 
+        return false;
+    }
+
+    // tileMapから刻子と順子を取り出して、frameに設定する
+    // どちらも最も小さい牌から始まるものを取り出す
+    inline void expandFrame(TileMap tileMap, bool noTriple, SplitFrame& frame) {
+        constexpr TileMap tripleLowerMask = 7;   //  111b を
+        constexpr TileMap tripleFullMask  = 15;  // 1111b から取り出して
+        constexpr TileMap tripleUpperMask = 8;   // 1000b を残す
+        constexpr TileMap sequenceLowerMask =  0x421;  //     10000100001b を
+        constexpr TileMap sequenceFullMask  = 0x3def;  // 011110111101111b から取り出して
+        constexpr TileMap sequenceUpperMask = 0x7bde;  // 111101111011110b を残す
+
+        TileMap triplePositions = 0;
+        TileMap sequencePositions = 0;
+        findMeldPositions(tileMap, triplePositions, sequencePositions);
+        triplePositions = noTriple ? 0 : triplePositions;
+
+        extractLowest(tileMap, triplePositions, tripleLowerMask, tripleFullMask, tripleUpperMask,
+                      frame.triple, frame.tripleRest);
+        extractLowest(tileMap, sequencePositions, sequenceLowerMask, sequenceFullMask, sequenceUpperMask,
+                      frame.sequence, frame.sequenceRest);
+
+        // 一度刻子が取り出せなくなったら、以後は順子だけ探す
+        frame.noTriple = noTriple || (frame.triple == 0);
+        frame.status = SplitStatus::NOT_SEARCHED;
+        return;
+    }
+
+    // tileMapから取り出せる刻子と順子の位置を、ループせずにすべて求める
+    // 各牌の最下位bit(5n bit目)に、その牌から始まる刻子または順子があれば1を立てる
+    // 刻子 : 3牌目のbitが1である
+    // 順子 : その牌、次の牌、その次の牌の最下位bitがすべて1である(10索以上は常に0なので789までになる)
+    inline static void findMeldPositions(TileMap tileMap, TileMap& triplePositions, TileMap& sequencePositions) {
+        asm (
+            "mov   %0, %2 \n\t"
+            "shr   %0, 2  \n\t"
+            "and   %0, %3 \n\t"
+
+            "mov   %1, %2 \n\t"
+            "shr   %1, 5  \n\t"
+            "and   %1, %2 \n\t"
+            "mov   r15, %2 \n\t"
+            "shr   r15, 10 \n\t"
+            "and   %1, r15 \n\t"
+            "and   %1, %3 \n\t"
+            :"=&r"(triplePositions),"=&r"(sequencePositions):"r"(tileMap),"r"(TileLowerBits):"r15");
         return;
     }
 
-    // tileMapからlowerMaskを取り出して、取り出せたらextractedに、残りをrestに入れる
+    // positionsのうち最も小さい牌の位置から、lowerMaskをtileMapから取り出して、extractedに、残りをrestに入れる
+    // 位置がなければextractedを0にする
     // lowerMask : 各桁から取り出すbitの集合
     // fullMask  : 各桁の全5bitsの集合
     // upperMask : 各桁から取り出した後の残りbitの集合
-    inline void splitWithMask(TileMap tileMap, TileMap lowerMask, TileMap fullMask, TileMap upperMask,
-                              TileMap& extracted, TileMap& rest) {
+    inline static void extractLowest(TileMap tileMap, TileMap positions,
+                                     TileMap lowerMask, TileMap fullMask, TileMap upperMask,
+                                     TileMap& extracted, TileMap& rest) {
         asm (
-            "mov  %1, %2  \n\t"
-            "mov  r15, %2  \n\t"
-            "and  r15, %3  \n\t"
-            "cmp  r15, %3  \n\t"
-            "jz   2f \n\t"
-
-            "mov  ecx, 8 \n\t"
-            "1: \n\t"
-            // 次の牌の組を調べる
-            "shl  %3, 5  \n\t"
-            "shl  %4, 5  \n\t"
-            "shl  %5, 5  \n\t"
-            "mov  r15, %2  \n\t"
-            "and  r15, %3  \n\t"
-            "cmp  r15, %3  \n\t"
-            "loopne 1b \n\t"
-            "jnz    3f \n\t"
-
-            // ビットパターンが見つかったので取り出す
-            "2: \n\t"
-            "pext  r15, %2,  %5  \n\t"
-            "pdep  r15, r15, %4  \n\t"
-            "andn  %1, %4, %1 \n\t"
-            "or    %1, r15    \n\t"
-
-            // ビットパターンが見つかったらその値、見つからなければ0を返す
-            "3: \n\t"
-            "xor  %0, %0  \n\t"
-            "cmp  %1, %2  \n\t"
-            "cmovnz  %0, %3  \n\t"
-            :"=&r"(extracted),"=&r"(rest),"+r"(tileMap),"+r"(lowerMask),"+r"(fullMask),"+r"(upperMask)::"rcx","r15");
+            ".set  RegPos,  rcx \n\t"
+
+            "tzcnt  RegPos, %2 \n\t"
+            "shlx   %4, %4, RegPos \n\t"
+            "shlx   %5, %5, RegPos \n\t"
+            "shlx   %6, %6, RegPos \n\t"
+
+            // 取り出した後の残りbitを、各桁の右側に寄せる
+            "pext   r15, %3,  %6 \n\t"
+            "pdep   r15, r15, %5 \n\t"
+            "andn   %1, %5, %3 \n\t"
+            "or     %1, r15 \n\t"
+
+            // 位置があればその値、なければ0を返す
+            "xor    %0, %0 \n\t"
+            "test   %2, %2 \n\t"
+            "cmovnz %0, %4 \n\t"
+            :"=&r"(extracted),"=&r"(rest),"+r"(positions),"+r"(tileMap),"+r"(lowerMask),"+r"(fullMask),"+r"(upperMask)::"rcx","r15");
 
         return;
     }
 
     TileMap src_;
+    uint64_t triedPairs_;   // 分解を試そうとした(待ち, 対子)の組の数
+    uint64_t prunedPairs_;  // そのうち分解する前に除いた数
 };
 
 namespace {
@@ -546,8 +845,10 @@ namespace {
     // これ以上待ち形がないときは非0を、あれば0返す
     // numberの待ち形をtileMapに設定する
     // numberの待ち形を解いて文字列を設定する場合は、enablePatternにfalseを、設定しないときはfalseを設定する
-    inline TileMap enumerateOne(bool enablePattern, TileMap number,
-                                TileMap& tileMap, TileMap& nextNumber, StrArray& result) {
+    // 結果はStrArrayかResultBufferに格納する
+    template <typename Result>
+    inline TileMap enumerateOne(bool enablePattern, TileMap number, const HandFilter& filter,
+                                TileMap& tileMap, TileMap& nextNumber, Result& result) {
         TileMap invalid = 0;
         TileMap enablePatternQ = enablePattern;
 
@@ -774,32 +1075,117 @@ namespace {
         pXmmValueSet = nullptr;
 
         if (enablePattern) {
-            std::string patternStr = patternCharSet.str;
+            // スレッドごとに作業用の文字列を使いまわして、結果を格納する分だけ確保する
+            // std::moveで渡すと、作業用の文字列を伸ばすたびに確保し直すので(一手牌あたり約1.5回)、写す
+            static thread_local std::string patternStr;
             Puzzle puzzle(tileMap);
-            patternStr += puzzle.Find();
-            result.push_back(std::move(patternStr));
+            if (puzzle.Find(filter, patternCharSet.str, patternStr)) {
+                result.push_back(patternStr);
+            }
+            switchPerfPhase(PerfEnumerate);
         }
 
         return invalid;
     }
-}
 
-namespace TileSetSolver {
-    // 各スレッドは、indexOffset番目(先頭は0)から、stepSize個間隔で、待ち形を求める
-    void EnumerateAll(SizeType indexOffset, SizeType stepSize, StrArray& result) {
+    // EnumerateRangeの本体
+    template <typename Result>
+    void enumerateRange(const HandRange& range, SizeType indexOffset, SizeType stepSize,
+                        const HandFilter& filter, Result& result) {
+        if (range.first >= range.last) {
+            return;
+        }
+
+        // 測るならスレッドごとの分布を用意する。一つ数十KBあるのでスタックに置かない。
+        std::unique_ptr<SolveLatency> latency;
+        if (solveLatencyEnabled.load()) {
+            latency.reset(new SolveLatency());
+            currentSolveLatency = latency.get();
+        }
+
+        // 有効なら、スレッドごとに区間を分けて性能カウンタを数える。名前はこのスレッドが解く最初の手牌の順番にする。
+        const auto perfCollector = StartPerfCounters("solver", range.first + indexOffset, PerfEnumerate);
+        currentPerfCollector = perfCollector.get();
+
         decltype(indexOffset) patternIndex = 0;
-        TileMap number = 0x1111222233334;  // 辞書順で一番小さいパターン
+        SizeType rank = range.first;
+        TileMap number = GetHandNumber(rank);  // 先頭は辞書順で一番小さいパターン(0x1111222233334)
         TileMap tileMap = 0;
         TileMap nextNumber = 0;
         TileMap invalid = 0;
 
         // while{}より速い
         do {
-            invalid = enumerateOne((patternIndex == indexOffset), number, tileMap, nextNumber, result);
+            invalid = enumerateOne((patternIndex == indexOffset), number, filter, tileMap, nextNumber, result);
             ++patternIndex;
             patternIndex = (patternIndex >= stepSize) ? 0 : patternIndex;
             number = nextNumber;
-        } while(!invalid);
+            ++rank;
+        } while(!invalid && (rank < range.last));
+        currentPerfCollector = nullptr;
+
+        if (latency) {
+            currentSolveLatency = nullptr;
+            MergeSolveLatency(*latency);
+        }
+        return;
+    }
+}
+
+namespace TileSetSolver {
+    void SolveHand(HandNumber number, WaitResult& result) {
+        // 問い合わせとAPIは一手牌ずつ解くので、測るなら一手牌ごとに全スレッドの合計に足す
+        Puzzle puzzle(HandToTileMap(number));
+        if (solveLatencyEnabled.load(std::memory_order_relaxed)) {
+            puzzle.SolveMeasured(result, nullptr);
+        } else {
+            puzzle.Solve(result);
+        }
+        return;
+    }
+
+    void PrintWaitKeys(const TileKey* keys, SizeType size, std::string& str) {
+        Puzzle::Print(keys, size, str);
+        return;
+    }
+
+    TileMap FindWaitMask(HandNumber number) {
+        Puzzle puzzle(HandToTileMap(number));
+        return puzzle.FindWaitMask();
+    }
+
+    PruneCount GetPruneCount(void) {
+        return PruneCount {triedPairCount.load(), prunedPairCount.load()};
+    }
+
+    void EnableSolveLatency(bool enable) {
+        solveLatencyEnabled.store(enable);
+        return;
+    }
+
+    // 各スレッドは、indexOffset番目(先頭は0)から、stepSize個間隔で、待ち形を求める
+    void EnumerateAll(SizeType indexOffset, SizeType stepSize, StrArray& result) {
+        const HandFilter filter;
+        EnumerateAll(indexOffset, stepSize, filter, result);
+        return;
+    }
+
+    void EnumerateAll(SizeType indexOffset, SizeType stepSize, const HandFilter& filter, StrArray& result) {
+        const HandRange range;
+        EnumerateRange(range, indexOffset, stepSize, filter, result);
+        return;
+    }
+
+    void EnumerateRange(const HandRange& range, SizeType indexOffset, SizeType stepSize,
+                        const HandFilter& filter, StrArray& result) {
+        enumerateRange(range, indexOffset, stepSize, filter, result);
+        return;
+    }
+
+    void EnumerateRange(const HandRange& range, SizeType indexOffset, SizeType stepSize,
+                        const HandFilter& filter, ResultBuffer& result) {
+        enumerateRange(range, indexOffset, stepSize, filter, result);
+        return;
     }
 }
 
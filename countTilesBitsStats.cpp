@@ -0,0 +1,233 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * すべての手牌を解いて、待ちの集計だけを書き出す
+ * 各スレッドは自分の集計に数えて、最後にまとめる。手牌ごとの文字列は作らない。
+ * 待ち形のキーを読み解く関数もここに置く。
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    const char* const WaitShapeNameSet[SizeOfWaitShapes] = {"single", "pair", "sides", "edge", "closed"};
+
+    // 一組のキー(SizeOfKeyBits bit)の中身
+    // bit 9 : 待ち形
+    // bit 4..8 : 最も小さい牌の位置から、その牌の1,2,3牌目、次の牌、その次の牌があるかどうか
+    // bit 0..3 : 最も小さい牌の位置を4で割った値
+    constexpr TileKey KeyPatternShift = 4;
+    constexpr TileKey KeyPatternMask = 0x1f;
+    constexpr TileKey KeyPositionMask = 0xf;
+    constexpr TileKey PatternSingle   = 0x01;  // 1牌
+    constexpr TileKey PatternPair     = 0x03;  // 同じ牌が2牌
+    constexpr TileKey PatternTriple   = 0x07;  // 同じ牌が3牌
+    constexpr TileKey PatternAdjacent = 0x09;  // 隣り合う2牌
+    constexpr TileKey PatternGap      = 0x11;  // 一つ空けた2牌
+    constexpr TileKey PatternSequence = 0x19;  // 順子
+
+    // 刻子と順子の数は0..4
+    constexpr SizeType SizeOfMeldCounts = 5;
+    constexpr SizeType SizeOfShapes = SizeOfWaitShapes * SizeOfMeldCounts * SizeOfMeldCounts;
+    // 表示する分解の形の数
+    constexpr SizeType SizeOfTopShapes = 10;
+
+    // 集計
+    struct HandStats {
+        std::array<uint64_t, TileMax + 1> waitsPerHand {};       // 待ち牌の数ごとの手牌の数
+        std::array<uint64_t, MaxSizeOfWaits + 1> formsPerHand {}; // 待ち形の数ごとの手牌の数
+        std::array<uint64_t, TileMax + 1> handsPerWaitTile {};   // 待ち牌ごとの手牌の数
+        std::array<uint64_t, SizeOfShapes> shapeSet {};          // 分解の形ごとの数
+
+        void Merge(const HandStats& other) {
+            merge(waitsPerHand, other.waitsPerHand);
+            merge(formsPerHand, other.formsPerHand);
+            merge(handsPerWaitTile, other.handsPerWaitTile);
+            merge(shapeSet, other.shapeSet);
+            return;
+        }
+
+    private:
+        template <typename T>
+        static void merge(T& to, const T& from) {
+            for(SizeType i = 0; i < to.size(); ++i) {
+                to[i] += from[i];
+            }
+            return;
+        }
+    };
+
+    // 位置を4で割った値から牌の番号に戻す(1牌5bitなので、5で割った分だけずれる)
+    TileKey getLowestTile(TileKey key) {
+        const auto position = key & KeyPositionMask;
+        return position - position / 5 + TileMin;
+    }
+
+    // 待ち形のキーから、待ち形の種類と刻子と順子の数を数えて、分解の形の番号を返す
+    SizeType getShapeIndex(TileKey tileKey) {
+        constexpr TileKey mask = (1 << SizeOfKeyBits) - 1;
+        // 最上位は待ち形
+        const auto waitShape = GetWaitShape((tileKey >> (SizeOfKeyBits * (SizeOfTileSet - 1))) & mask);
+
+        SizeType sizeOfTriples = 0;
+        SizeType sizeOfSequences = 0;
+        for(SizeType i = 0; i < (SizeOfTileSet - 1); ++i) {
+            const auto pattern = ((tileKey >> (SizeOfKeyBits * i)) >> KeyPatternShift) & KeyPatternMask;
+            sizeOfTriples += (pattern == PatternTriple) ? 1 : 0;
+            sizeOfSequences += (pattern == PatternSequence) ? 1 : 0;
+        }
+
+        return (waitShape * SizeOfMeldCounts + sizeOfTriples) * SizeOfMeldCounts + sizeOfSequences;
+    }
+
+    // 手牌の番号がfirst以上last未満の手牌を解いて、statsに数える
+    void collectPart(SizeType first, SizeType last, HandStats& stats) {
+        WaitResult result;
+        for(SizeType rank = first; rank < last; ++rank) {
+            SolveHand(GetHandNumber(rank), result);
+            ++stats.waitsPerHand[__builtin_popcountll(result.waitMask)];
+            ++stats.formsPerHand[result.keys.size()];
+
+            for(SizeType tile = TileMin; tile <= TileMax; ++tile) {
+                stats.handsPerWaitTile[tile] += (result.waitMask >> (tile - TileMin)) & 1;
+            }
+
+            for(auto key : result.keys) {
+                ++stats.shapeSet[getShapeIndex(key)];
+            }
+        }
+        return;
+    }
+
+    void printStats(const HandStats& stats, std::ostream& os) {
+        os << "hands: " << SizeOfAllHands << "\n"
+           << "none: " << stats.waitsPerHand[0] << "\n"
+           << "waits per hand:\n";
+        for(SizeType i = 0; i < stats.waitsPerHand.size(); ++i) {
+            if (stats.waitsPerHand[i]) {
+                os << "  " << i << " : " << stats.waitsPerHand[i] << "\n";
+            }
+        }
+
+        os << "forms per hand:\n";
+        for(SizeType i = 0; i < stats.formsPerHand.size(); ++i) {
+            if (stats.formsPerHand[i]) {
+                os << "  " << i << " : " << stats.formsPerHand[i] << "\n";
+            }
+        }
+
+        os << "hands per wait tile:\n";
+        for(SizeType tile = TileMin; tile <= TileMax; ++tile) {
+            os << "  " << tile << " : " << stats.handsPerWaitTile[tile] << "\n";
+        }
+
+        // 多い順(同数なら番号順)に並べる
+        std::vector<SizeType> indexSet(SizeOfShapes);
+        for(SizeType i = 0; i < SizeOfShapes; ++i) {
+            indexSet[i] = i;
+        }
+        std::stable_sort(indexSet.begin(), indexSet.end(),
+                         [&stats](SizeType l, SizeType r) { return stats.shapeSet[l] > stats.shapeSet[r]; });
+
+        os << "top shapes:\n";
+        for(SizeType i = 0; (i < SizeOfTopShapes) && stats.shapeSet[indexSet[i]]; ++i) {
+            const auto index = indexSet[i];
+            os << "  " << stats.shapeSet[index] << " : wait=" << GetWaitShapeName(static_cast<WaitShape>(index / (SizeOfMeldCounts * SizeOfMeldCounts)))
+               << " triples=" << ((index / SizeOfMeldCounts) % SizeOfMeldCounts)
+               << " sequences=" << (index % SizeOfMeldCounts) << "\n";
+        }
+
+        return;
+    }
+}
+
+namespace TileSetSolver {
+    const char* GetWaitShapeName(WaitShape shape) {
+        return WaitShapeNameSet[shape];
+    }
+
+    WaitShape GetWaitShape(TileKey openKey) {
+        const auto pattern = (openKey >> KeyPatternShift) & KeyPatternMask;
+        if (pattern == PatternSingle) {
+            return WaitSingle;
+        }
+        if (pattern == PatternPair) {
+            return WaitPair;
+        }
+        if (pattern == PatternGap) {
+            return WaitClosed;
+        }
+
+        const auto tile = getLowestTile(openKey);
+        return ((tile == TileMin) || (tile == (TileMax - 1))) ? WaitEdge : WaitSides;
+    }
+
+    std::string OpenKeyToString(TileKey openKey) {
+        const auto tile = getLowestTile(openKey);
+        const char lowest = static_cast<char>('0' + tile);
+        std::string str = "[";
+        str += lowest;
+        switch((openKey >> KeyPatternShift) & KeyPatternMask) {
+        case PatternPair:
+            str += lowest;
+            break;
+        case PatternAdjacent:
+            str += static_cast<char>(lowest + 1);
+            break;
+        case PatternGap:
+            str += static_cast<char>(lowest + 2);
+            break;
+        default:
+            break;
+        }
+        str += "]";
+        return str;
+    }
+
+    void CollectStats(SizeType sizeOfThreads, std::ostream& os) {
+        sizeOfThreads = std::max(sizeOfThreads, static_cast<SizeType>(1));
+        std::vector<HandStats> statsSet(sizeOfThreads);
+        std::vector<THREAD_FUTURE<void>> futureSet;
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
+            const SizeType first = SizeOfAllHands * index / sizeOfThreads;
+            const SizeType last = SizeOfAllHands * (index + 1) / sizeOfThreads;
+            futureSet.push_back(
+                THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                             [&statsSet, index, first, last](void) -> void
+                             {
+                                 // スレッドのスタックで数えて、最後に一度だけ書き戻す
+                                 HandStats stats;
+                                 collectPart(first, last, stats);
+                                 statsSet.at(index) = stats;
+                             }));
+        }
+
+        HandStats total;
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
+            futureSet.at(index).get();
+            total.Merge(statsSet.at(index));
+        }
+
+        printStats(total, os);
+        return;
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,201 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * 全手牌の待ちを格納した表
+ * 表の形式(数値はすべて実行環境のバイトオーダー)
+ *   WaitTableHeader
+ *   uint32_t offsets[SizeOfAllHands + 1] : 手牌の順番ごとの、keysの開始位置
+ *   uint16_t masks[SizeOfAllHands]       : 手牌の順番ごとの、待ち牌の集合
+ *   (8byte境界まで0で埋める)
+ *   TileKey  keys[sizeOfKeys]            : 待ち形のキー
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+using namespace TileSetSolver;
+
+// 埋め込んだ表の先頭と末尾(countTilesBitsEmbedded.S)
+extern "C" const unsigned char EmbeddedWaitTable[];
+extern "C" const unsigned char EmbeddedWaitTableEnd[];
+
+namespace {
+    constexpr char WaitTableMagic[8] = {'C', 'T', 'W', 'A', 'I', 'T', 'S', '\0'};
+    constexpr uint32_t WaitTableVersion = 1;  // 形式か出力が変わったら上げる
+
+    struct WaitTableHeader {
+        char     magic[8];
+        uint32_t version;
+        uint32_t sizeOfHands;
+        uint64_t sizeOfKeys;
+        uint64_t checksum;  // ヘッダより後ろのFNV-1a 64bit
+    };
+
+    constexpr SizeType SizeOfOffsets = sizeof(uint32_t) * (SizeOfAllHands + 1);
+    constexpr SizeType SizeOfMasks = sizeof(uint16_t) * SizeOfAllHands;
+    constexpr SizeType OffsetOfOffsets = sizeof(WaitTableHeader);
+    constexpr SizeType OffsetOfMasks = OffsetOfOffsets + SizeOfOffsets;
+    constexpr SizeType OffsetOfKeys = (OffsetOfMasks + SizeOfMasks + sizeof(TileKey) - 1) & ~(sizeof(TileKey) - 1);
+
+    uint64_t getChecksum(const unsigned char* data, SizeType size) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for(SizeType i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // 一スレッドが解いた結果
+    struct PartialTable {
+        std::vector<uint8_t>  sizeSet;  // 手牌ごとの待ち形の数
+        std::vector<uint16_t> maskSet;  // 手牌ごとの待ち牌の集合
+        std::vector<TileKey>  keySet;   // 待ち形のキーを手牌の順に連結したもの
+    };
+
+    void solvePart(SizeType indexOffset, SizeType stepSize, PartialTable& part) {
+        WaitResult result;
+        for(SizeType rank = indexOffset; rank < SizeOfAllHands; rank += stepSize) {
+            SolveHand(GetHandNumber(rank), result);
+            part.sizeSet.push_back(static_cast<uint8_t>(result.keys.size()));
+            part.maskSet.push_back(static_cast<uint16_t>(result.waitMask));
+            part.keySet.insert(part.keySet.end(), result.keys.begin(), result.keys.end());
+        }
+        return;
+    }
+}
+
+namespace TileSetSolver {
+    WaitTableView::WaitTableView(void) : offsets_(nullptr), masks_(nullptr), keys_(nullptr) {
+        return;
+    }
+
+    bool WaitTableView::Attach(const void* data, SizeType size, bool verifyChecksum) {
+        offsets_ = nullptr;
+        masks_ = nullptr;
+        keys_ = nullptr;
+
+        const auto bytes = static_cast<const unsigned char*>(data);
+        if ((bytes == nullptr) || (size < OffsetOfKeys) ||
+            ((reinterpret_cast<uintptr_t>(bytes) % sizeof(TileKey)) != 0)) {
+            return false;
+        }
+
+        WaitTableHeader header;
+        ::memcpy(&header, bytes, sizeof(header));
+        if ((::memcmp(header.magic, WaitTableMagic, sizeof(WaitTableMagic)) != 0) ||
+            (header.version != WaitTableVersion) || (header.sizeOfHands != SizeOfAllHands) ||
+            (header.sizeOfKeys != ((size - OffsetOfKeys) / sizeof(TileKey)))) {
+            return false;
+        }
+
+        const auto offsets = reinterpret_cast<const uint32_t*>(bytes + OffsetOfOffsets);
+        if ((offsets[0] != 0) || (offsets[SizeOfAllHands] != header.sizeOfKeys)) {
+            return false;
+        }
+
+        if (verifyChecksum &&
+            (getChecksum(bytes + sizeof(header), size - sizeof(header)) != header.checksum)) {
+            return false;
+        }
+
+        offsets_ = offsets;
+        masks_ = reinterpret_cast<const uint16_t*>(bytes + OffsetOfMasks);
+        keys_ = reinterpret_cast<const TileKey*>(bytes + OffsetOfKeys);
+        return true;
+    }
+
+    bool WaitTableView::IsValid(void) const {
+        return (offsets_ != nullptr);
+    }
+
+    TileMap WaitTableView::GetWaitMask(SizeType rank) const {
+        return masks_[rank];
+    }
+
+    const TileKey* WaitTableView::GetKeys(SizeType rank) const {
+        return keys_ + offsets_[rank];
+    }
+
+    SizeType WaitTableView::GetSizeOfKeys(SizeType rank) const {
+        return offsets_[rank + 1] - offsets_[rank];
+    }
+
+    void WaitTableView::Print(SizeType rank, std::string& str) const {
+        str += HandToString(GetHandNumber(rank));
+        str += ":\n";
+        PrintWaitKeys(GetKeys(rank), GetSizeOfKeys(rank), str);
+        return;
+    }
+
+    std::vector<char> BuildWaitTable(SizeType sizeOfThreads) {
+        sizeOfThreads = (sizeOfThreads > 0) ? sizeOfThreads : 1;
+        std::vector<PartialTable> partSet(sizeOfThreads);
+        std::vector<THREAD_FUTURE<void>> futureSet;
+        for(SizeType index = 0; index < sizeOfThreads; ++index) {
+            futureSet.push_back(
+                THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                             [&partSet, index, sizeOfThreads](void) -> void
+                             { solvePart(index, sizeOfThreads, partSet.at(index)); }));
+        }
+        for(auto& f : futureSet) {
+            f.get();
+        }
+
+        SizeType sizeOfKeys = 0;
+        for(auto& part : partSet) {
+            sizeOfKeys += part.keySet.size();
+        }
+
+        std::vector<char> table(OffsetOfKeys + sizeof(TileKey) * sizeOfKeys, 0);
+        auto bytes = reinterpret_cast<unsigned char*>(table.data());
+
+        // 各スレッドはsizeOfThreads個間隔で解いたので、交互に取り出すと番号順になる
+        std::vector<SizeType> positionSet(sizeOfThreads, 0);
+        uint32_t offset = 0;
+        for(SizeType rank = 0; rank < SizeOfAllHands; ++rank) {
+            auto& part = partSet.at(rank % sizeOfThreads);
+            const auto i = rank / sizeOfThreads;
+            const auto size = part.sizeSet.at(i);
+            const uint16_t mask = part.maskSet.at(i);
+
+            ::memcpy(bytes + OffsetOfOffsets + sizeof(uint32_t) * rank, &offset, sizeof(offset));
+            ::memcpy(bytes + OffsetOfMasks + sizeof(uint16_t) * rank, &mask, sizeof(mask));
+            auto& position = positionSet.at(rank % sizeOfThreads);
+            ::memcpy(bytes + OffsetOfKeys + sizeof(TileKey) * offset,
+                     part.keySet.data() + position, sizeof(TileKey) * size);
+            position += size;
+            offset += size;
+        }
+        ::memcpy(bytes + OffsetOfOffsets + sizeof(uint32_t) * SizeOfAllHands, &offset, sizeof(offset));
+
+        WaitTableHeader header;
+        ::memcpy(header.magic, WaitTableMagic, sizeof(WaitTableMagic));
+        header.version = WaitTableVersion;
+        header.sizeOfHands = SizeOfAllHands;
+        header.sizeOfKeys = sizeOfKeys;
+        header.checksum = getChecksum(bytes + sizeof(header), table.size() - sizeof(header));
+        ::memcpy(bytes, &header, sizeof(header));
+        return table;
+    }
+
+    bool GetEmbeddedWaitTable(WaitTableView& view) {
+        // 実行ファイルの一部なので壊れていないとみなして、チェックサムは確かめない
+        const SizeType size = static_cast<SizeType>(EmbeddedWaitTableEnd - EmbeddedWaitTable);
+        return view.Attach(EmbeddedWaitTable, size, false);
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,46 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * スレッドを使う処理が共通に使う定義
+ * boost/thread/future.hpp とIntel Syntaxのインラインアセンブリは同じ.cppファイルに書けないので、
+ * インラインアセンブリを書く.cppファイルからはインクルードしないこと
+ */
+
+#ifdef USE_BOOST_THREAD
+// MinGWではstd::threadが使えないので、boost::threadを使う
+#include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
+#define THREAD_FUTURE boost::unique_future
+#define THREAD_ASYNC  boost::async
+#define THREAD_LAUNCH_ASYNC  boost::launch::async
+#define THREAD_HARDWARE_CONCURRENCY  boost::thread::hardware_concurrency
+#define THREAD_TYPE   boost::thread
+#define THREAD_MUTEX  boost::mutex
+#define THREAD_CONDITION_VARIABLE  boost::condition_variable
+#define THREAD_UNIQUE_LOCK  boost::unique_lock
+#define THREAD_YIELD  boost::this_thread::yield
+#else
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#define THREAD_FUTURE std::future
+#define THREAD_ASYNC  std::async
+#define THREAD_LAUNCH_ASYNC std::launch::async
+#define THREAD_HARDWARE_CONCURRENCY  std::thread::hardware_concurrency
+#define THREAD_TYPE   std::thread
+#define THREAD_MUTEX  std::mutex
+#define THREAD_CONDITION_VARIABLE  std::condition_variable
+#define THREAD_UNIQUE_LOCK  std::unique_lock
+#define THREAD_YIELD  std::this_thread::yield
+#endif
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,134 @@
+/*
+ * 出題元
+ * http://www.itmedia.co.jp/enterprise/articles/1004/03/news002_2.html
+ *
+ * countTiles.cpp (CountTiles) とビットボード (TileSetSolver) の二つの実装で
+ * すべての手牌を解いて、結果をメモリ上で比べる
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "countTiles.hpp"
+#include "countTilesBits.hpp"
+#include "countTilesBitsThread.hpp"
+
+using namespace TileSetSolver;
+
+namespace {
+    // 結果が異なる手牌
+    struct Mismatch {
+        std::string hand;      // 手牌
+        std::string expected;  // CountTilesの結果
+        std::string actual;    // TileSetSolverの結果
+    };
+    using MismatchArray = std::vector<Mismatch>;
+
+    // 表示する不一致の数の上限
+    constexpr SizeType MaxSizeOfReportedMismatches = 10;
+
+    // 行内の牌の組と、行の並びを整列して、順不同の結果を比べられるようにする
+    std::string canonicalize(const std::string& body) {
+        std::vector<std::string> lineSet;
+        std::istringstream is(body);
+        std::string line;
+
+        while(std::getline(is, line)) {
+            std::vector<std::string> tokenSet;
+            std::string::size_type pos = 0;
+            while(pos < line.size()) {
+                const auto last = line.find_first_of(")]", pos);
+                if (last == std::string::npos) {
+                    tokenSet.push_back(line.substr(pos));
+                    break;
+                }
+                tokenSet.push_back(line.substr(pos, last + 1 - pos));
+                pos = last + 1;
+            }
+
+            std::sort(tokenSet.begin(), tokenSet.end());
+            std::string sortedLine;
+            for(auto& token : tokenSet) {
+                sortedLine += token;
+            }
+            lineSet.push_back(std::move(sortedLine));
+        }
+
+        std::sort(lineSet.begin(), lineSet.end());
+        std::string str;
+        for(auto& sortedLine : lineSet) {
+            str += sortedLine;
+            str += "\n";
+        }
+        return str;
+    }
+
+    // indexOffset番目(先頭は0)から、stepSize個間隔で、手牌を二つの実装で解いて比べる
+    void verifyPart(SizeType indexOffset, SizeType stepSize, SizeType& sizeOfHands, MismatchArray& mismatchSet) {
+        StrArray result;
+        EnumerateAll(indexOffset, stepSize, result);
+        sizeOfHands = result.size();
+
+        for(auto& str : result) {
+            // 手牌 ':' 改行 待ち
+            const auto pos = str.find(':');
+            const auto hand = str.substr(0, pos);
+            const auto actual = str.substr(pos + 2);
+            const auto expected = CountTiles::SearchWaits(hand);
+            if (canonicalize(expected) != canonicalize(actual)) {
+                mismatchSet.push_back(Mismatch{hand, expected, actual});
+            }
+        }
+
+        return;
+    }
+}
+
+namespace TileSetSolver {
+    bool VerifyAll(SizeType sizeOfThreads, std::ostream& os) {
+        sizeOfThreads = std::max(sizeOfThreads, static_cast<SizeType>(1));
+        CountTiles::PrepareTileSets();
+
+        std::vector<SizeType> sizeSet(sizeOfThreads, 0);
+        std::vector<MismatchArray> mismatchSetArray(sizeOfThreads);
+        std::vector<THREAD_FUTURE<void>> futureSet;
+        for(decltype(sizeOfThreads) index = 0; index < sizeOfThreads; ++index) {
+            futureSet.push_back(
+                THREAD_ASYNC(THREAD_LAUNCH_ASYNC,
+                             [&sizeSet, &mismatchSetArray, index, sizeOfThreads](void) -> void
+                             { verifyPart(index, sizeOfThreads, sizeSet.at(index), mismatchSetArray.at(index)); }));
+        }
+
+        for(auto& f : futureSet) {
+            f.get();
+        }
+
+        SizeType sizeOfHands = 0;
+        SizeType sizeOfMismatches = 0;
+        for(decltype(sizeOfThreads) index = 0; index < sizeOfThreads; ++index) {
+            sizeOfHands += sizeSet.at(index);
+            for(auto& mismatch : mismatchSetArray.at(index)) {
+                if (sizeOfMismatches < MaxSizeOfReportedMismatches) {
+                    os << "Mismatch " << mismatch.hand << "\nexpected\n" << mismatch.expected
+                       << "actual\n" << mismatch.actual;
+                }
+                ++sizeOfMismatches;
+            }
+        }
+
+        os << "Verified " << sizeOfHands << " hands : " << sizeOfMismatches << " mismatches\n";
+        return (sizeOfMismatches == 0);
+    }
+}
+
+/*
+Local Variables:
+mode: c++
+coding: utf-8-dos
+tab-width: nil
+c-file-style: "stroustrup"
+End:
+*/
@@ -0,0 +1,88 @@
+#!/usr/bin/ruby
+# coding: utf-8
+#
+# countTilesBits --shard=i/N (または --from, --to) の出力をつないで、全手牌の出力にする
+# 使い方: ruby countTilesMergeShards.rb [-o 出力ファイル] [--check 全手牌の出力] ファイル...
+# 各ファイルの前後の#行から範囲と手牌の数を読み、範囲が重ならず隙間なく全手牌を覆うことと、
+# 途中で切れていないことを確かめる。--checkを指定すると、つないだ結果がそのファイルと一致するか確かめる。
+
+require 'optparse'
+
+# 入力形式の異常
+class ShardError < StandardError
+end
+
+# 一つの範囲の出力
+class Shard
+  attr_reader :filename, :first, :last, :total, :body
+
+  HEADER = /\A# countTilesBits shard=\d+\/\d+ first=(\d+) last=(\d+) total=(\d+)\z/
+  FOOTER = /\A# end hands=(\d+)\z/
+
+  def initialize(filename)
+    @filename = filename
+    lineSet = File.open(filename, "rb") { |file| file.readlines }
+    reportError("empty file") if lineSet.empty?
+
+    header = HEADER.match(lineSet.first.chomp)
+    reportError("no header") unless header
+    @first, @last, @total = header.captures.map(&:to_i)
+
+    footer = FOOTER.match(lineSet.last.chomp)
+    reportError("no footer (truncated?)") unless footer
+
+    bodySet = lineSet[1..-2]
+    sizeOfHands = bodySet.count { |line| line.chomp.end_with?(":") }
+    reportError("#{sizeOfHands} hands written but footer says #{footer[1]}") unless sizeOfHands == footer[1].to_i
+    @body = bodySet.join
+  end
+
+  def reportError(str)
+    raise ShardError.new("#{@filename}: #{str}")
+  end
+end
+
+# 範囲を順に並べて、重なりと隙間がないか確かめてつなぐ
+def mergeShards(shardSet)
+  raise ShardError.new("no input files") if shardSet.empty?
+  sortedSet = shardSet.sort_by { |shard| [shard.first, shard.last] }
+  total = sortedSet.first.total
+
+  position = 0
+  sortedSet.each do |shard|
+    shard.reportError("total #{shard.total} differs from #{total}") unless shard.total == total
+    shard.reportError("starts at #{shard.first}, expected #{position} (gap or overlap)") unless shard.first == position
+    position = shard.last
+  end
+  raise ShardError.new("shards end at #{position}, expected #{total}") unless position == total
+
+  sortedSet.map(&:body).join
+end
+
+outputFilename = nil
+checkFilename = nil
+OptionParser.new do |opt|
+  opt.banner = "Usage: ruby countTilesMergeShards.rb [-o output] [--check full_output] files..."
+  opt.on("-o FILE", "write merged output to FILE instead of stdout") { |v| outputFilename = v }
+  opt.on("--check FILE", "compare merged output with FILE") { |v| checkFilename = v }
+end.parse!(ARGV)
+
+begin
+  merged = mergeShards(ARGV.map { |filename| Shard.new(filename) })
+
+  if outputFilename
+    File.open(outputFilename, "wb") { |file| file.write(merged) }
+  elsif !checkFilename
+    $stdout.binmode
+    $stdout.write(merged)
+  end
+
+  if checkFilename
+    expected = File.open(checkFilename, "rb") { |file| file.read }
+    raise ShardError.new("merged output differs from #{checkFilename}") unless merged == expected
+    $stderr.puts "Merged #{ARGV.size} files and matched #{checkFilename}"
+  end
+rescue ShardError, SystemCallError => e
+  $stderr.puts e.message
+  exit(1)
+end